@@ -0,0 +1,86 @@
+#pragma once
+#include "MirroredRingBuffer.h"
+#include <JuceHeader.h>
+#include <memory>
+
+namespace DSP {
+// Plain delay used when the engine is bypassed, so the dry signal comes out
+// with the same latency the host is compensating for.
+//
+// push() only records the input. The engine does that on every processed
+// block as well, so the line is already full of recent audio at the moment
+// it switches to bypass.
+template <typename SampleType> class BypassDelay {
+public:
+  // Not realtime safe
+  void prepare(int newDelaySamples, size_t maxBlockSize,
+               size_t newNumChannels) {
+    delaySamples = (size_t)juce::jmax(0, newDelaySamples);
+    maxBlock = maxBlockSize;
+    numChannels = juce::jmax((size_t)1, newNumChannels);
+
+    // A whole block goes in before any of it is read back
+    lines = std::make_unique<MirroredRingBuffer<SampleType>[]>(numChannels);
+    for (size_t ch = 0; ch < numChannels; ++ch)
+      lines[ch].allocate(delaySamples + maxBlock);
+    reset();
+  }
+
+  void reset() {
+    for (size_t ch = 0; ch < numChannels && lines != nullptr; ++ch)
+      lines[ch].clear();
+    writePos = 0;
+  }
+
+  size_t getDelayLineBytes() const {
+    size_t bytes = 0;
+    for (size_t ch = 0; ch < numChannels && lines != nullptr; ++ch)
+      bytes += lines[ch].getBytes();
+    return bytes;
+  }
+
+  void push(const juce::dsp::AudioBlock<SampleType> &block) {
+    const auto numSamples = block.getNumSamples();
+    const auto channels = juce::jmin(block.getNumChannels(), numChannels);
+    jassert(numSamples <= maxBlock);
+
+    for (size_t ch = 0; ch < channels; ++ch) {
+      juce::FloatVectorOperations::copy(lines[ch].window(writePos),
+                                        block.getChannelPointer(ch),
+                                        (int)numSamples);
+      lines[ch].written(writePos, numSamples);
+    }
+
+    writePos += numSamples;
+  }
+
+  // Replaces the block with the input from delaySamples ago
+  void process(juce::dsp::AudioBlock<SampleType> &block) {
+    push(block);
+
+    const auto numSamples = block.getNumSamples();
+    const auto channels = juce::jmin(block.getNumChannels(), numChannels);
+
+    for (size_t ch = 0; ch < channels; ++ch)
+      juce::FloatVectorOperations::copy(block.getChannelPointer(ch),
+                                        getDelayed(ch, numSamples),
+                                        (int)numSamples);
+  }
+
+  // What process() would put in place of the last `numSamples` pushed, for
+  // mixing the dry signal in with the processed one
+  const SampleType *getDelayed(size_t channel, size_t numSamples) const {
+    jassert(channel < numChannels && numSamples <= maxBlock);
+    return lines[channel].window(writePos - numSamples - delaySamples);
+  }
+
+private:
+  size_t delaySamples = 0;
+  size_t maxBlock = 0;
+  size_t numChannels = 0;
+
+  // One per channel; the ring buffers can't be moved, so no vector
+  std::unique_ptr<MirroredRingBuffer<SampleType>[]> lines;
+  size_t writePos = 0;
+};
+} // namespace DSP
@@ -0,0 +1,122 @@
+#pragma once
+#include <JuceHeader.h>
+#include <cmath>
+#include <vector>
+
+namespace DSP {
+// Coefficient design for the 2x half-band stages in Oversampler. Transition
+// widths are normalised to the oversampled rate (0.05 = 5% of it) and centred
+// on a quarter of that rate; attenuations are positive dB.
+namespace HalfBandDesign {
+
+// Polyphase allpass IIR (Valenzuela & Constantinides, elliptic prototype).
+// Returns the first-order allpass coefficients; even indices belong to the
+// first path, odd indices to the second.
+inline std::vector<double> polyphaseIIR(double transitionWidth,
+                                        double attenuationDB) {
+  constexpr double pi = juce::MathConstants<double>::pi;
+
+  // Elliptic modulus and nome for the transition band
+  auto k = std::tan((1.0 - transitionWidth * 2.0) * pi / 4.0);
+  k *= k;
+  const auto kkSqrt = std::pow(1.0 - k * k, 0.25);
+  const auto e = 0.5 * (1.0 - kkSqrt) / (1.0 + kkSqrt);
+  const auto e4 = e * e * e * e;
+  const auto q = e * (1.0 + e4 * (2.0 + e4 * (15.0 + 150.0 * e4)));
+
+  // Smallest odd order that reaches the attenuation
+  const auto attenuation = std::pow(10.0, -attenuationDB / 10.0);
+  const auto a = attenuation / (1.0 - attenuation);
+  auto order = (int)std::ceil(std::log(a * a / 16.0) / std::log(q));
+  order |= 1;
+  order = juce::jmax(3, order);
+
+  std::vector<double> coefficients;
+
+  for (int c = 1; c <= (order - 1) / 2; ++c) {
+    double num = 0.0, den = 0.0;
+
+    for (int i = 0;; ++i) {
+      const auto term = std::pow(q, (double)(i * (i + 1))) *
+                        std::sin((i * 2 + 1) * c * pi / order) *
+                        ((i & 1) != 0 ? -1.0 : 1.0);
+      num += term;
+      if (std::abs(term) < 1.0e-100)
+        break;
+    }
+
+    for (int i = 1;; ++i) {
+      const auto term = std::pow(q, (double)(i * i)) *
+                        std::cos(i * 2 * c * pi / order) *
+                        ((i & 1) != 0 ? -1.0 : 1.0);
+      den += term;
+      if (std::abs(term) < 1.0e-100)
+        break;
+    }
+
+    const auto ww = num * std::pow(q, 0.25) / (den + 0.5);
+    const auto wwSq = ww * ww;
+    const auto x =
+        std::sqrt((1.0 - wwSq * k) * (1.0 - wwSq / k)) / (1.0 + wwSq);
+    coefficients.push_back((1.0 - x) / (1.0 + x));
+  }
+
+  return coefficients;
+}
+
+// Linear-phase half-band FIR, Kaiser-windowed sinc. The length is 4m + 3, so
+// the centre tap sits at an odd index: every other tap is then zero apart
+// from the centre one, and the even taps form the only non-trivial polyphase
+// branch. Returns just those even taps; the centre tap is always 0.5 and the
+// delay is (even taps - 1) samples at the oversampled rate.
+inline std::vector<double> linearPhaseFIR(double transitionWidth,
+                                          double attenuationDB) {
+  constexpr double pi = juce::MathConstants<double>::pi;
+
+  // Kaiser's estimates come out a dB or two short once the length is
+  // rounded to the half-band form, so design with a little margin
+  const auto designDB = attenuationDB + 2.0;
+
+  const auto estimate =
+      (designDB - 8.0) / (2.285 * 2.0 * pi * transitionWidth) + 1.0;
+  const auto m = juce::jmax(1, (int)std::ceil((estimate - 3.0) / 4.0));
+  const auto length = 4 * m + 3;
+  const auto centre = (length - 1) / 2;
+
+  const auto beta = designDB > 50.0
+                        ? 0.1102 * (designDB - 8.7)
+                        : 0.5842 * std::pow(designDB - 21.0, 0.4) +
+                              0.07886 * (designDB - 21.0);
+
+  // Zeroth order modified Bessel function of the first kind
+  auto besselI0 = [](double x) {
+    double sum = 1.0, term = 1.0;
+    for (int i = 1; term > 1.0e-12 * sum; ++i) {
+      term *= (x / (2.0 * i)) * (x / (2.0 * i));
+      sum += term;
+    }
+    return sum;
+  };
+
+  std::vector<double> taps;
+  double sum = 0.0;
+
+  for (int n = 0; n < length; n += 2) {
+    const auto t = (double)(n - centre);
+    const auto r = t / centre;
+    const auto window =
+        besselI0(beta * std::sqrt(1.0 - r * r)) / besselI0(beta);
+    const auto sinc = std::sin(0.5 * pi * t) / (pi * t);
+    taps.push_back(sinc * window);
+    sum += taps.back();
+  }
+
+  // Both branches should pass DC at exactly the same gain, so the even taps
+  // add up to the centre tap.
+  for (auto &tap : taps)
+    tap *= 0.5 / sum;
+
+  return taps;
+}
+} // namespace HalfBandDesign
+} // namespace DSP
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+
+namespace DSP {
+// Per-sample values for a parameter moving from `start` to `end` over one
+// block: a straight line whose last value is exactly `end`, so the next
+// block carries on from there. A plain loop, which the compiler vectorizes.
+template <typename SampleType>
+inline void fillLinearRamp(SampleType *ramp, SampleType start, SampleType end,
+                           size_t numSamples) noexcept {
+  if (numSamples == 0)
+    return;
+
+  const auto step = (end - start) / (SampleType)numSamples;
+
+  for (size_t i = 0; i < numSamples; ++i)
+    ramp[i] = start + step * (SampleType)(i + 1);
+
+  ramp[numSamples - 1] = end;
+}
+} // namespace DSP
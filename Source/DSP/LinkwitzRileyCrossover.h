@@ -0,0 +1,97 @@
+#pragma once
+#include "StateArena.h"
+#include <JuceHeader.h>
+#include <cmath>
+
+namespace DSP {
+// 4th order Linkwitz-Riley band split for `lanes` channels at once (a stereo
+// pair by default), low and high band in one pass.
+//
+// Same TPT state variable structure as juce::dsp::LinkwitzRileyFilter: two
+// cascaded 2nd order Butterworth sections give the lowpass, and the highpass
+// comes from the allpass complement of the first section (HP = AP - LP), so
+// there is no second filter chain for the high band.
+//
+// The channels are stored side by side and every step runs the same maths on
+// each lane, so the compiler can keep them in one SIMD register.
+//
+// The filter state lives in the owner's StateArena, in the hot section:
+// call prepare(), then layoutState(), then reset().
+template <typename SampleType, size_t lanes = 2> class LinkwitzRileyCrossover {
+public:
+  static constexpr size_t numLanes = lanes;
+
+  void prepare(double newSampleRate) {
+    sampleRate = newSampleRate;
+    updateCoefficients();
+  }
+
+  void layoutState(StateArena::Layout &layout) {
+    state = layout.hot<State>(1);
+  }
+
+  // A no-op until layoutState() has placed the state
+  void reset() {
+    if (state != nullptr)
+      *state = {};
+  }
+
+  void setCutoffFrequency(double newCutoff) {
+    cutoff = newCutoff;
+    updateCoefficients();
+  }
+
+  // Samples for the response to decay by 120 dB. The Butterworth poles
+  // decay as exp(-wc t / sqrt2); the factor of 2 covers the second section.
+  int getRingOutSamples() const {
+    const auto decayRate =
+        juce::MathConstants<double>::twoPi * cutoff / (double)R2;
+    return (int)std::ceil(2.0 * std::log(1.0e6) / decayRate * sampleRate);
+  }
+
+  // Splits one sample per lane into low and high bands
+  inline void processSample(const SampleType (&in)[numLanes],
+                            SampleType (&low)[numLanes],
+                            SampleType (&high)[numLanes]) noexcept {
+    auto &s1 = state->s1, &s2 = state->s2, &s3 = state->s3, &s4 = state->s4;
+
+    for (size_t lane = 0; lane < numLanes; ++lane) {
+      // First section: HP, BP and LP outputs share the same state
+      const auto yH = (in[lane] - (R2 + g) * s1[lane] - s2[lane]) * h;
+      const auto yB = g * yH + s1[lane];
+      s1[lane] = g * yH + yB;
+      const auto yL = g * yB + s2[lane];
+      s2[lane] = g * yB + yL;
+
+      // Second section on the lowpass output only
+      const auto yH2 = (yL - (R2 + g) * s3[lane] - s4[lane]) * h;
+      const auto yB2 = g * yH2 + s3[lane];
+      s3[lane] = g * yH2 + yB2;
+      const auto yL2 = g * yB2 + s4[lane];
+      s4[lane] = g * yB2 + yL2;
+
+      low[lane] = yL2;
+      high[lane] = yL - R2 * yB + yH - yL2;
+    }
+  }
+
+private:
+  void updateCoefficients() {
+    g = (SampleType)std::tan(juce::MathConstants<double>::pi * cutoff /
+                             sampleRate);
+    h = SampleType(1) / (SampleType(1) + R2 * g + g * g);
+  }
+
+  static constexpr SampleType R2 = juce::MathConstants<SampleType>::sqrt2;
+
+  double sampleRate = 44100.0;
+  double cutoff = 2000.0;
+  SampleType g = 0, h = 0;
+
+  struct State {
+    SampleType s1[numLanes], s2[numLanes], s3[numLanes], s4[numLanes];
+  };
+
+  State *state = nullptr;
+};
+} // namespace DSP
@@ -0,0 +1,157 @@
+#pragma once
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if JUCE_LINUX || JUCE_ANDROID
+#include <sys/mman.h>
+#include <unistd.h>
+#define VCORE_MIRRORED_RING_MMAP 1
+#endif
+
+namespace DSP {
+// Ring buffer where any window of up to getCapacity() elements, starting at
+// any index, is one contiguous span of memory. Delay lines can then read and
+// write whole blocks with straight-line loops and no wraparound checks.
+//
+// On Linux the same physical pages are mapped twice, back to back (memfd +
+// mmap), so the second half of the mapping *is* the first half. Elsewhere, or
+// if the mapping fails, it falls back to a power-of-two buffer of twice the
+// capacity, and written() copies each write into the other half to keep them
+// in step.
+//
+// Indices are free-running counters: window() masks them, so callers can
+// just keep adding to their read/write positions and let them wrap.
+//
+// Usage: write into window(writePos), call written(writePos, n), then read
+// from window(readPos) for up to getCapacity() elements.
+template <typename T> class MirroredRingBuffer {
+public:
+  MirroredRingBuffer() = default;
+  ~MirroredRingBuffer() { release(); }
+
+  // Capacity becomes a power of two >= minCapacity (and a whole number of
+  // pages when mirrored). Not realtime safe.
+  void allocate(size_t minCapacity) {
+    release();
+
+    capacity =
+        (size_t)juce::nextPowerOfTwo((int)juce::jmax((size_t)1, minCapacity));
+
+#if VCORE_MIRRORED_RING_MMAP
+    const auto pageSize = (size_t)::sysconf(_SC_PAGESIZE);
+    capacity = juce::jmax(capacity, pageSize / sizeof(T));
+    mirrored = mapMirrored(capacity * sizeof(T));
+#endif
+
+    if (!mirrored) {
+      fallback.assign(capacity * 2, T{});
+      storage = fallback.data();
+    }
+
+    mask = capacity - 1;
+    clear();
+  }
+
+  void clear() {
+    if (storage != nullptr)
+      std::fill(storage, storage + (mirrored ? capacity : capacity * 2), T{});
+  }
+
+  size_t getCapacity() const noexcept { return capacity; }
+  bool isMirrored() const noexcept { return mirrored; }
+
+  // Physical memory behind the buffer; the mirrored mapping costs nothing
+  size_t getBytes() const noexcept {
+    return capacity * sizeof(T) * (mirrored ? 1 : 2);
+  }
+
+  // Start of a contiguous window of getCapacity() elements at `index`
+  T *window(size_t index) noexcept { return storage + (index & mask); }
+  const T *window(size_t index) const noexcept {
+    return storage + (index & mask);
+  }
+
+  // Publishes `count` elements written into window(index). A no-op when the
+  // pages are mirrored; otherwise copies them into the other half.
+  void written(size_t index, size_t count) noexcept {
+    jassert(count <= capacity);
+    if (mirrored)
+      return;
+
+    const auto start = index & mask;
+    const auto end = start + count;
+
+    if (start < capacity) {
+      const auto lowEnd = juce::jmin(end, capacity);
+      std::memcpy(storage + start + capacity, storage + start,
+                  (lowEnd - start) * sizeof(T));
+    }
+
+    if (end > capacity) {
+      const auto highStart = juce::jmax(start, capacity);
+      std::memcpy(storage + highStart - capacity, storage + highStart,
+                  (end - highStart) * sizeof(T));
+    }
+  }
+
+private:
+#if VCORE_MIRRORED_RING_MMAP
+  bool mapMirrored(size_t bytes) {
+    const auto fd = ::memfd_create("vcore-ring", MFD_CLOEXEC);
+    if (fd < 0)
+      return false;
+
+    auto ok = ::ftruncate(fd, (off_t)bytes) == 0;
+
+    // Reserve both halves first so nothing else can land in between
+    auto *base = ok ? ::mmap(nullptr, bytes * 2, PROT_NONE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+                    : MAP_FAILED;
+    ok = base != MAP_FAILED;
+
+    for (size_t half = 0; ok && half < 2; ++half) {
+      auto *address = static_cast<char *>(base) + half * bytes;
+      ok = ::mmap(address, bytes, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_FIXED, fd, 0) == address;
+    }
+
+    ::close(fd);
+
+    if (!ok) {
+      if (base != MAP_FAILED)
+        ::munmap(base, bytes * 2);
+      return false;
+    }
+
+    storage = static_cast<T *>(base);
+    mappedBytes = bytes * 2;
+    return true;
+  }
+#endif
+
+  void release() {
+#if VCORE_MIRRORED_RING_MMAP
+    if (mirrored)
+      ::munmap(storage, mappedBytes);
+    mappedBytes = 0;
+#endif
+    fallback.clear();
+    fallback.shrink_to_fit();
+    storage = nullptr;
+    mirrored = false;
+    capacity = 0;
+    mask = 0;
+  }
+
+  T *storage = nullptr;
+  size_t capacity = 0;
+  size_t mask = 0;
+  bool mirrored = false;
+  size_t mappedBytes = 0;
+  std::vector<T> fallback;
+
+  JUCE_DECLARE_NON_COPYABLE(MirroredRingBuffer)
+};
+} // namespace DSP
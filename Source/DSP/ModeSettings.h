@@ -0,0 +1,59 @@
+#pragma once
+
+namespace DSP {
+// What the engine does in one position of the mode knob. Outside the engine
+// template so the plugin can build and pass these around for either
+// precision.
+struct ModeSettings {
+  // Skip every stage and only delay the signal by the engine latency
+  bool bypass = false;
+  float thresholdDB = 0.0f;
+  float width = 0.0f;
+  float saturationDrive = 0.0f;
+  float makeupGainDB = 0.0f;
+
+  bool operator==(const ModeSettings &) const = default;
+};
+
+constexpr int numModes = 5;
+
+inline ModeSettings getModeSettings(int modeIndex) {
+  ModeSettings settings;
+
+  switch (modeIndex) {
+  case 0: // BYPASS / CLEAN
+    settings.bypass = true;
+    settings.thresholdDB = 0.0f;
+    settings.width = 0.0f;
+    settings.saturationDrive = 0.0f;
+    settings.makeupGainDB = 0.0f;
+    break;
+  case 1: // NATURAL
+    settings.thresholdDB = -3.0f;
+    settings.width = 0.10f;
+    settings.saturationDrive = 0.1f;
+    settings.makeupGainDB = 2.0f;
+    break;
+  case 2: // LIVE / STREAM
+    settings.thresholdDB = -6.0f;
+    settings.width = 0.25f;
+    settings.saturationDrive = 0.2f;
+    settings.makeupGainDB = 5.0f;
+    break;
+  case 3: // VOCAL / POWER
+    settings.thresholdDB = -9.0f;
+    settings.width = 0.40f;
+    settings.saturationDrive = 0.3f;
+    settings.makeupGainDB = 8.0f;
+    break;
+  case 4: // BROADCAST
+    settings.thresholdDB = -12.0f;
+    settings.width = 0.55f;
+    settings.saturationDrive = 0.4f;
+    settings.makeupGainDB = 11.0f;
+    break;
+  }
+
+  return settings;
+}
+} // namespace DSP
@@ -0,0 +1,577 @@
+#pragma once
+#include "HalfBandDesign.h"
+#include "SharedTableRegistry.h"
+#include "StateArena.h"
+#include <JuceHeader.h>
+#include <cmath>
+#include <tuple>
+#include <vector>
+
+namespace DSP {
+// Half-band filters used by Oversampler. IIR is minimum-phase-ish with a few
+// samples of latency; linear phase costs more CPU and latency.
+enum class OversamplingFilter { iir, linearPhase };
+
+// 2x, 4x or 8x oversampling as a cascade of 2x half-band stages, each either
+// a polyphase allpass IIR (low latency, minimum-phase-ish) or a linear-phase
+// FIR. Filter specs follow juce::dsp::Oversampling at max quality: the stage
+// nearest the host rate has the narrowest transition band and the most
+// attenuation, later stages relax both.
+//
+// The coefficients are read-only and identical for every instance with the
+// same factor, filter and sample type, so they live in a process-wide
+// SharedTableRegistry rather than per instance. Filter state and the
+// intermediate buffers come from a StateArena: call configure(), then
+// layoutState(), then reset(), or prepare() for standalone use.
+//
+// The latency is always a whole number of host samples: whatever fraction the
+// filters leave is topped up with a first-order Thiran allpass on the output.
+// The fraction includes any delay the caller adds between the up and down
+// passes (the ADAA saturator's half sample), so that is compensated too, at
+// 1x as well.
+//
+// The IIR allpass chains are a serial recursion per channel, so channels go
+// through them in pairs, side by side in the state and in the inner loop,
+// and the compiler can keep both in one SIMD register (the same trick as
+// LinkwitzRileyCrossover). An odd channel out is paired with itself.
+template <typename SampleType> class Oversampler {
+public:
+  using Filter = OversamplingFilter;
+
+  static constexpr size_t numLanes = 2;
+
+  static constexpr size_t maxFactorLog2 = 3; // 8x
+
+  struct HalfBand {
+    std::vector<SampleType> path0, path1; // IIR: allpass coefs per path
+    std::vector<SampleType> taps; // FIR: the non-zero polyphase branch
+    double latency = 0.0;         // In host samples
+    double ringOut = 0.0;         // Impulse response length, host samples
+  };
+
+  // One entry per 2x stage, the one nearest the host rate first
+  struct Tables {
+    struct Stage {
+      HalfBand up, down;
+    };
+
+    Filter filter = Filter::iir;
+    std::vector<Stage> stages;
+
+    size_t getBytes() const {
+      auto bytes = sizeof(Tables) + stages.size() * sizeof(Stage);
+      for (const auto &stage : stages)
+        for (const auto *band : {&stage.up, &stage.down})
+          bytes += (band->path0.size() + band->path1.size() +
+                    band->taps.size()) *
+                   sizeof(SampleType);
+      return bytes;
+    }
+  };
+
+  // Shared, immutable coefficients for a factor/filter pair. The designs are
+  // normalised to the stage rate, so the host sample rate isn't part of the
+  // key and sessions at 44.1k and 48k share the same tables.
+  static std::shared_ptr<const Tables> getTables(size_t factorLog2,
+                                                 Filter filter) {
+    static SharedTableRegistry<std::tuple<size_t, Filter>, Tables> registry;
+    return registry.get({factorLog2, filter},
+                        [&] { return designTables(factorLog2, filter); });
+  }
+
+  // Standalone use: state goes in the oversampler's own arena
+  void prepare(size_t newNumChannels, size_t factorLog2, Filter filter,
+               size_t maximumBlockSize, double innerDelay = 0.0) {
+    configure(newNumChannels, factorLog2, filter, maximumBlockSize,
+              innerDelay);
+    ownState.build([this](StateArena::Layout &l) { layoutState(l); });
+    reset();
+  }
+
+  // Fetches the tables and works out sizes and latency. Follow with
+  // layoutState() and reset(). `innerDelay` is the group delay of whatever
+  // the caller runs between processSamplesUp() and processSamplesDown(), in
+  // samples at the oversampled rate; it counts towards the latency.
+  void configure(size_t newNumChannels, size_t factorLog2, Filter filter,
+                 size_t maximumBlockSize, double innerDelay = 0.0) {
+    jassert(factorLog2 <= maxFactorLog2);
+
+    numChannels = juce::jmax((size_t)1, newNumChannels);
+    maxBlockSize = maximumBlockSize;
+    tables = getTables(juce::jmin(factorLog2, maxFactorLog2), filter);
+
+    // IIR state is one array: every up stage, then every down stage, each
+    // with all of one channel pair's sections before the next pair's.
+    numPairs = (numChannels + 1) / numLanes;
+    numSections = 0;
+    for (size_t k = 0; k < tables->stages.size(); ++k) {
+      upSectionOffset[k] = numSections;
+      numSections += sectionsPerChannel(tables->stages[k].up) * numPairs;
+    }
+    for (size_t k = 0; k < tables->stages.size(); ++k) {
+      downSectionOffset[k] = numSections;
+      numSections += sectionsPerChannel(tables->stages[k].down) * numPairs;
+    }
+
+    double latency = innerDelay / (double)getOversamplingFactor();
+    for (const auto &stage : tables->stages)
+      latency += stage.up.latency + stage.down.latency;
+
+    // Round up to whole samples; Thiran works best for delays of 0.5 to 1.5
+    // samples, so top up by one more when the fraction is small.
+    auto fraction = std::ceil(latency - 1.0e-9) - latency;
+    compensate = fraction > 1.0e-9;
+    if (compensate && fraction < 0.5)
+      fraction += 1.0;
+
+    compensationCoef =
+        compensate ? (SampleType)((1.0 - fraction) / (1.0 + fraction)) : 0;
+    latencySamples = juce::roundToInt(latency + (compensate ? fraction : 0.0));
+
+    double ringOut = compensate ? sectionRingOut(compensationCoef) : 0.0;
+    for (const auto &stage : tables->stages)
+      ringOut += stage.up.ringOut + stage.down.ringOut;
+    tailSamples = (int)std::ceil(ringOut);
+  }
+
+  void layoutState(StateArena::Layout &layout) {
+    const auto numStages = tables->stages.size();
+
+    // Filter state: IIR sections are touched every sample, so they go with
+    // the other hot state. FIR history is buffer-sized.
+    sections = layout.hot<Section>(numSections);
+    thiranState = layout.hot<Section>(numPairs);
+
+    for (size_t k = 0; k < numStages; ++k) {
+      const auto &stage = tables->stages[k];
+      auto &buffers = stageBuffers[k];
+
+      // Output of up stage k, at 2^(k+1) times the host rate. The channel
+      // pointer table is filled in by reset().
+      buffers.length = maxBlockSize << (k + 1);
+      buffers.data = layout.cold<SampleType>(buffers.length * numChannels);
+      buffers.channels = layout.cold<SampleType *>(numChannels);
+
+      // FIR history: past input followed by the block being processed
+      buffers.upHistoryLength =
+          stage.up.taps.empty() ? 0
+                                : (maxBlockSize << k) + stage.up.taps.size();
+      buffers.downHistoryLength =
+          stage.down.taps.empty() ? 0
+                                  : buffers.length + 2 * stage.down.taps.size();
+
+      buffers.upHistory =
+          layout.cold<SampleType>(buffers.upHistoryLength * numChannels);
+      buffers.downHistory =
+          layout.cold<SampleType>(buffers.downHistoryLength * numChannels);
+    }
+  }
+
+  // A no-op until layoutState() has placed the state
+  void reset() {
+    if (thiranState == nullptr)
+      return;
+
+    std::fill(sections, sections + numSections, Section{});
+    std::fill(thiranState, thiranState + numPairs, Section{});
+
+    for (size_t k = 0; k < tables->stages.size(); ++k) {
+      auto &buffers = stageBuffers[k];
+      for (size_t ch = 0; ch < numChannels; ++ch)
+        buffers.channels[ch] = buffers.data + ch * buffers.length;
+
+      std::fill(buffers.upHistory,
+                buffers.upHistory + buffers.upHistoryLength * numChannels,
+                SampleType(0));
+      std::fill(buffers.downHistory,
+                buffers.downHistory + buffers.downHistoryLength * numChannels,
+                SampleType(0));
+    }
+  }
+
+  size_t getOversamplingFactor() const {
+    return (size_t)1 << tables->stages.size();
+  }
+
+  // Coefficients in use, shared with every other instance using them
+  size_t getTableBytes() const { return tables->getBytes(); }
+
+  // Whole host samples, up and down together
+  int getLatencySamples() const { return latencySamples; }
+
+  // How long the output takes to die away (below -120 dB) after the input
+  // goes silent, in host samples
+  int getTailSamples() const { return tailSamples; }
+
+  // Upsamples `input` and returns a block over the internal buffer holding
+  // the result, which stays valid until the next call. With a factor of 1
+  // this is `input` itself.
+  juce::dsp::AudioBlock<SampleType>
+  processSamplesUp(const juce::dsp::AudioBlock<SampleType> &input) {
+    const auto numStages = tables->stages.size();
+    if (numStages == 0)
+      return input;
+
+    const auto channels = juce::jmin(numChannels, input.getNumChannels());
+    auto numSamples = input.getNumSamples();
+    jassert(numSamples <= maxBlockSize);
+
+    for (size_t k = 0; k < numStages; ++k) {
+      const auto &band = tables->stages[k].up;
+      auto &buffers = stageBuffers[k];
+      auto *state = sections + upSectionOffset[k];
+
+      auto source = [&](size_t ch) -> const SampleType * {
+        return k == 0 ? input.getChannelPointer(ch)
+                      : stageBuffers[k - 1].channels[ch];
+      };
+
+      if (tables->filter == Filter::iir) {
+        for (size_t pair = 0; pair * numLanes < channels; ++pair) {
+          const auto ch0 = pair * numLanes;
+          const auto ch1 = juce::jmin(ch0 + 1, channels - 1);
+          const SampleType *src[] = {source(ch0), source(ch1)};
+          SampleType *dst[] = {buffers.channels[ch0], buffers.channels[ch1]};
+          upIIR(band, state + pair * sectionsPerChannel(band), src, dst,
+                numSamples);
+        }
+      } else {
+        for (size_t ch = 0; ch < channels; ++ch)
+          upFIR(band, buffers.upHistory + ch * buffers.upHistoryLength,
+                source(ch), buffers.channels[ch], numSamples);
+      }
+
+      numSamples *= 2;
+    }
+
+    return juce::dsp::AudioBlock<SampleType>(
+        stageBuffers[numStages - 1].channels, channels, numSamples);
+  }
+
+  // Downsamples the result of the last processSamplesUp() into `output`. At
+  // a factor of 1 that only leaves the fractional delay compensation, if the
+  // inner delay needs any.
+  void processSamplesDown(juce::dsp::AudioBlock<SampleType> &output) {
+    const auto numStages = tables->stages.size();
+    if (numStages == 0 && !compensate)
+      return;
+
+    const auto channels = juce::jmin(numChannels, output.getNumChannels());
+    auto numSamples = output.getNumSamples() << numStages;
+
+    for (size_t k = numStages; k-- > 0;) {
+      const auto &band = tables->stages[k].down;
+      auto &buffers = stageBuffers[k];
+      auto *state = sections + downSectionOffset[k];
+
+      auto destination = [&](size_t ch) {
+        return k == 0 ? output.getChannelPointer(ch)
+                      : stageBuffers[k - 1].channels[ch];
+      };
+
+      if (tables->filter == Filter::iir) {
+        for (size_t pair = 0; pair * numLanes < channels; ++pair) {
+          const auto ch0 = pair * numLanes;
+          const auto ch1 = juce::jmin(ch0 + 1, channels - 1);
+          const SampleType *src[] = {buffers.channels[ch0],
+                                     buffers.channels[ch1]};
+          SampleType *dst[] = {destination(ch0), destination(ch1)};
+          downIIR(band, state + pair * sectionsPerChannel(band), src, dst,
+                  numSamples / 2);
+        }
+      } else {
+        for (size_t ch = 0; ch < channels; ++ch)
+          downFIR(band, buffers.downHistory + ch * buffers.downHistoryLength,
+                  buffers.channels[ch], destination(ch), numSamples / 2);
+      }
+
+      numSamples /= 2;
+    }
+
+    if (compensate) {
+      for (size_t pair = 0; pair * numLanes < channels; ++pair) {
+        const auto ch0 = pair * numLanes;
+        const auto ch1 = juce::jmin(ch0 + 1, channels - 1);
+        SampleType *samples[] = {output.getChannelPointer(ch0),
+                                 output.getChannelPointer(ch1)};
+        thiran(thiranState[pair], samples, numSamples);
+      }
+    }
+  }
+
+private:
+  // First-order allpass state for a channel pair: previous input and output
+  // of each lane
+  struct Section {
+    SampleType x1[numLanes] = {}, y1[numLanes] = {};
+  };
+
+  struct StageBuffers {
+    size_t length = 0;
+    SampleType *data = nullptr;
+    SampleType **channels = nullptr;
+    size_t upHistoryLength = 0, downHistoryLength = 0;
+    SampleType *upHistory = nullptr, *downHistory = nullptr;
+  };
+
+  // The specs are the ones juce::dsp::Oversampling uses at max quality, which
+  // is what the engine ran before this class: the same transition widths
+  // (halved at the first stage), stopbands of 75 dB up and 70 dB down for the
+  // IIR and 90 dB up for the FIR (75 dB down, 5 dB more than JUCE's), each 10
+  // dB looser per later stage. A later stage only sees a signal that is already
+  // band limited to the host Nyquist, the bottom half or less of its band, so
+  // its images land well inside the stopband rather than at its edge, and the
+  // looser spec costs less than it reads. The measured worst image over 1-20
+  // kHz at 48 kHz (vcore_bench --images, run by ctest) is -80 dB at 2x and -70
+  // dB at 4x and 8x for the IIR, -97 and -96 dB for the FIR: each better than
+  // the spec of the stage that sets it.
+  static Tables designTables(size_t factorLog2, Filter filter) {
+    Tables tables;
+    tables.filter = filter;
+
+    for (size_t k = 0; k < factorLog2; ++k) {
+      const auto first = k == 0 ? 0.5 : 1.0;
+      const auto relax = 10.0 * (double)k;
+      const auto hostScale = 1.0 / (double)((size_t)1 << k);
+
+      typename Tables::Stage stage;
+
+      if (filter == Filter::iir) {
+        design(stage.up, HalfBandDesign::polyphaseIIR(0.10 * first,
+                                                      75.0 - relax));
+        design(stage.down, HalfBandDesign::polyphaseIIR(0.12 * first,
+                                                        70.0 - relax));
+
+        // DC group delay of each path in low-rate samples. Up: the second
+        // path is half a stage sample late. Down: its output is taken one
+        // high-rate sample early.
+        const auto up = pathDelay(stage.up.path0) + pathDelay(stage.up.path1);
+        const auto down =
+            pathDelay(stage.down.path0) + pathDelay(stage.down.path1);
+        stage.up.latency = 0.5 * (up + 0.5) * hostScale;
+        stage.down.latency = 0.5 * (down - 0.5) * hostScale;
+
+        // The paths run at the low rate of the stage
+        stage.up.ringOut = pathsRingOut(stage.up) * hostScale;
+        stage.down.ringOut = pathsRingOut(stage.down) * hostScale;
+      } else {
+        stage.up.taps = toSampleType(
+            HalfBandDesign::linearPhaseFIR(0.10 * first, 90.0 - relax));
+        stage.down.taps = toSampleType(
+            HalfBandDesign::linearPhaseFIR(0.12 * first, 75.0 - relax));
+
+        // Centre tap delay at the high rate, halved to the low rate
+        stage.up.latency =
+            0.5 * (double)(stage.up.taps.size() - 1) * hostScale;
+        stage.down.latency =
+            0.5 * (double)(stage.down.taps.size() - 1) * hostScale;
+
+        // Full length of the filter at the high rate (4 * taps - 1)
+        stage.up.ringOut =
+            0.5 * (double)(4 * stage.up.taps.size() - 1) * hostScale;
+        stage.down.ringOut =
+            0.5 * (double)(4 * stage.down.taps.size() - 1) * hostScale;
+      }
+
+      tables.stages.push_back(std::move(stage));
+    }
+
+    return tables;
+  }
+
+  static size_t sectionsPerChannel(const HalfBand &band) {
+    return band.path0.size() + band.path1.size();
+  }
+
+  static void design(HalfBand &band, const std::vector<double> &coefs) {
+    for (size_t i = 0; i < coefs.size(); ++i)
+      (i % 2 == 0 ? band.path0 : band.path1).push_back((SampleType)coefs[i]);
+  }
+
+  static std::vector<SampleType>
+  toSampleType(const std::vector<double> &values) {
+    return std::vector<SampleType>(values.begin(), values.end());
+  }
+
+  // DC group delay of a chain of (a + z^-1) / (1 + a z^-1) sections
+  static double pathDelay(const std::vector<SampleType> &path) {
+    double delay = 0.0;
+    for (auto a : path)
+      delay += (1.0 - a) / (1.0 + a);
+    return delay;
+  }
+
+  // Samples for one (a + z^-1) / (1 + a z^-1) section to decay by 120 dB
+  static double sectionRingOut(double a) {
+    a = std::abs(a);
+    return a > 1.0e-6 ? std::log(1.0e-6) / std::log(a) : 1.0;
+  }
+
+  // Low-rate samples for the slower path to ring out. Summing the sections
+  // over-estimates a cascade a little, which is the safe side.
+  static double pathsRingOut(const HalfBand &band) {
+    double ringOut[2] = {};
+    const std::vector<SampleType> *paths[] = {&band.path0, &band.path1};
+    for (size_t p = 0; p < 2; ++p)
+      for (auto a : *paths[p])
+        ringOut[p] += sectionRingOut(a);
+    return juce::jmax(ringOut[0], ringOut[1]);
+  }
+
+  using Lanes = SampleType[numLanes];
+
+  // One section on both lanes, in place
+  static inline void allpass(Section &s, SampleType a, Lanes &x) noexcept {
+    for (size_t lane = 0; lane < numLanes; ++lane) {
+      const auto y = a * (x[lane] - s.y1[lane]) + s.x1[lane];
+      s.x1[lane] = x[lane];
+      s.y1[lane] = y;
+      x[lane] = y;
+    }
+  }
+
+  // Both paths run on every input sample; path 0 gives the even outputs,
+  // path 1 the odd ones. When a channel is paired with itself both lanes
+  // compute the same thing, so writing it twice is harmless.
+  static void upIIR(const HalfBand &band, Section *state,
+                    const SampleType *const (&src)[numLanes],
+                    SampleType *const (&dst)[numLanes],
+                    size_t numSamples) noexcept {
+    const auto n0 = band.path0.size(), n1 = band.path1.size();
+    auto *state0 = state;
+    auto *state1 = state + n0;
+
+    for (size_t i = 0; i < numSamples; ++i) {
+      Lanes p0, p1;
+      for (size_t lane = 0; lane < numLanes; ++lane)
+        p0[lane] = p1[lane] = src[lane][i];
+
+      for (size_t s = 0; s < n0; ++s)
+        allpass(state0[s], band.path0[s], p0);
+      for (size_t s = 0; s < n1; ++s)
+        allpass(state1[s], band.path1[s], p1);
+
+      for (size_t lane = 0; lane < numLanes; ++lane) {
+        dst[lane][2 * i] = p0[lane];
+        dst[lane][2 * i + 1] = p1[lane];
+      }
+    }
+  }
+
+  // Odd input samples go through path 0, even ones through path 1
+  static void downIIR(const HalfBand &band, Section *state,
+                      const SampleType *const (&src)[numLanes],
+                      SampleType *const (&dst)[numLanes],
+                      size_t numOutputSamples) noexcept {
+    const auto n0 = band.path0.size(), n1 = band.path1.size();
+    auto *state0 = state;
+    auto *state1 = state + n0;
+
+    for (size_t i = 0; i < numOutputSamples; ++i) {
+      Lanes p0, p1;
+      for (size_t lane = 0; lane < numLanes; ++lane) {
+        p0[lane] = src[lane][2 * i + 1];
+        p1[lane] = src[lane][2 * i];
+      }
+
+      for (size_t s = 0; s < n0; ++s)
+        allpass(state0[s], band.path0[s], p0);
+      for (size_t s = 0; s < n1; ++s)
+        allpass(state1[s], band.path1[s], p1);
+
+      for (size_t lane = 0; lane < numLanes; ++lane)
+        dst[lane][i] = SampleType(0.5) * (p0[lane] + p1[lane]);
+    }
+  }
+
+  // Even outputs are the FIR branch (times 2 for the zero stuffing), odd
+  // outputs are the input delayed to the centre tap.
+  static void upFIR(const HalfBand &band, SampleType *history,
+                    const SampleType *src, SampleType *dst,
+                    size_t numSamples) noexcept {
+    const auto numTaps = band.taps.size();
+    const auto historyLength = numTaps - 1;
+    const auto centre = numTaps / 2 - 1;
+    const auto *taps = band.taps.data();
+
+    juce::FloatVectorOperations::copy(history + historyLength, src,
+                                      (int)numSamples);
+
+    for (size_t i = 0; i < numSamples; ++i) {
+      const auto *newest = history + historyLength + i;
+
+      SampleType sum = 0;
+      for (size_t t = 0; t < numTaps; ++t)
+        sum += taps[t] * newest[-(ptrdiff_t)t];
+
+      dst[2 * i] = SampleType(2) * sum;
+      dst[2 * i + 1] = newest[-(ptrdiff_t)centre];
+    }
+
+    std::copy(history + numSamples, history + numSamples + historyLength,
+              history);
+  }
+
+  // Output n is the filter at input sample 2n: the FIR branch on the even
+  // samples plus half the centre tap sample.
+  static void downFIR(const HalfBand &band, SampleType *history,
+                      const SampleType *src, SampleType *dst,
+                      size_t numOutputSamples) noexcept {
+    const auto numTaps = band.taps.size();
+    const auto historyLength = 2 * numTaps - 2;
+    const auto centre = numTaps - 1;
+    const auto *taps = band.taps.data();
+
+    juce::FloatVectorOperations::copy(history + historyLength, src,
+                                      (int)(2 * numOutputSamples));
+
+    for (size_t i = 0; i < numOutputSamples; ++i) {
+      const auto *newest = history + historyLength + 2 * i;
+
+      SampleType sum = 0;
+      for (size_t t = 0; t < numTaps; ++t)
+        sum += taps[t] * newest[-(ptrdiff_t)(2 * t)];
+
+      dst[i] = sum + SampleType(0.5) * newest[-(ptrdiff_t)centre];
+    }
+
+    const auto consumed = 2 * numOutputSamples;
+    std::copy(history + consumed, history + consumed + historyLength,
+              history);
+  }
+
+  void thiran(Section &state, SampleType *const (&samples)[numLanes],
+              size_t numSamples) noexcept {
+    for (size_t i = 0; i < numSamples; ++i) {
+      Lanes x;
+      for (size_t lane = 0; lane < numLanes; ++lane)
+        x[lane] = samples[lane][i];
+
+      allpass(state, compensationCoef, x);
+
+      for (size_t lane = 0; lane < numLanes; ++lane)
+        samples[lane][i] = x[lane];
+    }
+  }
+
+  size_t numChannels = 1;
+  size_t maxBlockSize = 0;
+  std::shared_ptr<const Tables> tables = getTables(0, Filter::iir);
+
+  int latencySamples = 0;
+  int tailSamples = 0;
+  bool compensate = false;
+  SampleType compensationCoef = 0;
+
+  size_t numPairs = 1;
+  size_t numSections = 0;
+  size_t upSectionOffset[maxFactorLog2] = {};
+  size_t downSectionOffset[maxFactorLog2] = {};
+
+  Section *sections = nullptr;
+  Section *thiranState = nullptr;
+  StageBuffers stageBuffers[maxFactorLog2];
+
+  StateArena ownState;
+};
+} // namespace DSP
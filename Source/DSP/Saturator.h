@@ -1,37 +1,160 @@
 #pragma once
+#include "FastMath.h"
+#include "LinearRamp.h"
+#include "StateArena.h"
 #include <JuceHeader.h>
 
 namespace DSP {
-class Saturator {
+// Which tanh implementation Saturator runs. `reference` is the exact
+// std::tanh loop, kept for A/B listening and null tests against `fast`.
+// `adaa` is a first-order antiderivative anti-aliased tanh, which suppresses
+// aliasing well enough to run at a lower oversampling factor. It adds half a
+// sample of delay, which VCoreEngine has the Oversampler compensate.
+enum class SaturatorKernel { reference, fast, adaa };
+
+template <typename SampleType> class Saturator {
 public:
+  using Kernel = SaturatorKernel;
+
+  // Standalone use: state goes in the saturator's own arena
   void prepare(const juce::dsp::ProcessSpec &spec) {
+    configure(spec);
+    ownState.build([this](StateArena::Layout &l) { layoutState(l); });
+    reset();
+  }
+
+  // Sizes only. Follow with layoutState() and reset().
+  void configure(const juce::dsp::ProcessSpec &spec) {
     sampleRate = spec.sampleRate;
+    numChannels = juce::jmax((size_t)1, (size_t)spec.numChannels);
+    maxBlockSize = (size_t)spec.maximumBlockSize;
+  }
+
+  void layoutState(StateArena::Layout &layout) {
+    adaaState = layout.hot<AdaaState>(numChannels);
+    gainRamp = layout.cold<SampleType>(maxBlockSize);
+  }
+
+  // A no-op until layoutState() has placed the state
+  void reset() {
+    if (adaaState != nullptr)
+      std::fill(adaaState, adaaState + numChannels, AdaaState{});
   }
 
-  void reset() {}
+  // Jumps straight to the new drive
+  void setDrive(float newDrive) { drive = rampStartDrive = newDrive; }
+
+  // Moves to the new drive sample by sample over the next process() call
+  void rampDrive(float newDrive) { drive = newDrive; }
 
-  void setDrive(float newDrive) { drive = newDrive; }
+  void setKernel(Kernel newKernel) {
+    if (newKernel != kernel)
+      reset();
+    kernel = newKernel;
+  }
+  Kernel getKernel() const { return kernel; }
 
   template <typename ProcessContext>
   void process(const ProcessContext &context) {
     auto &&inputBlock = context.getInputBlock();
     auto &&outputBlock = context.getOutputBlock();
 
+    // Gentle tanh saturation
+    // Input is boosted by drive, then saturated
+    const auto startGain = (SampleType)(1.0f + rampStartDrive * 2.0f);
+    const auto endGain = (SampleType)(1.0f + drive * 2.0f);
+    const auto numSamples = outputBlock.getNumSamples();
+    const auto ramping = startGain != endGain;
+    rampStartDrive = drive;
+
+    if (ramping) {
+      jassert(numSamples <= maxBlockSize);
+      fillLinearRamp(gainRamp, startGain, endGain, numSamples);
+    }
+
     for (size_t ch = 0; ch < outputBlock.getNumChannels(); ++ch) {
-      auto *src = inputBlock.getChannelPointer(ch);
+      const SampleType *src = inputBlock.getChannelPointer(ch);
       auto *dst = outputBlock.getChannelPointer(ch);
+      auto gain = endGain;
+
+      // While the drive moves, boost the input by the ramp first and run the
+      // kernel at unity gain
+      if (ramping) {
+        juce::FloatVectorOperations::multiply(dst, src, gainRamp,
+                                              (int)numSamples);
+        src = dst;
+        gain = SampleType(1);
+      }
+
+      switch (kernel) {
+      case Kernel::fast:
+        FastMath::tanhApprox(src, dst, numSamples, gain);
+        break;
 
-      for (size_t i = 0; i < outputBlock.getNumSamples(); ++i) {
-        // Gentle tanh saturation
-        // Input is boosted by drive, then saturated
-        float x = src[i] * (1.0f + drive * 2.0f);
-        dst[i] = std::tanh(x);
+      case Kernel::adaa:
+        jassert(ch < numChannels);
+        processAdaa(src, dst, numSamples, gain, adaaState[ch]);
+        break;
+
+      case Kernel::reference:
+        for (size_t i = 0; i < numSamples; ++i)
+          dst[i] = std::tanh(src[i] * gain);
+        break;
       }
     }
   }
 
 private:
+  struct AdaaState {
+    double x1 = 0.0;  // previous (driven) input
+    double ad1 = 0.0; // antiderivative at x1
+  };
+
+  // Antiderivative of tanh: log(cosh(x)), written so it doesn't overflow
+  static double logCosh(double x) {
+    constexpr double ln2 = 0.69314718055994530942;
+    const auto a = std::abs(x);
+    return a + std::log1p(std::exp(-2.0 * a)) - ln2;
+  }
+
+  // y[n] = (F(x[n]) - F(x[n-1])) / (x[n] - x[n-1]), i.e. the average of
+  // tanh over the segment between consecutive samples. When the two samples
+  // are too close the quotient is ill-conditioned, so use tanh of the
+  // midpoint, which is what the quotient converges to.
+  // Runs in double so the difference of antiderivatives keeps its precision.
+  static void processAdaa(const SampleType *src, SampleType *dst,
+                          size_t numSamples, SampleType gain,
+                          AdaaState &state) {
+    constexpr double tolerance = 1.0e-5;
+
+    auto x1 = state.x1;
+    auto ad1 = state.ad1;
+
+    for (size_t i = 0; i < numSamples; ++i) {
+      const auto x = (double)src[i] * (double)gain;
+      const auto ad = logCosh(x);
+      const auto dx = x - x1;
+
+      dst[i] = std::abs(dx) > tolerance
+                   ? (SampleType)((ad - ad1) / dx)
+                   : (SampleType)std::tanh(0.5 * (x + x1));
+      x1 = x;
+      ad1 = ad;
+    }
+
+    state.x1 = x1;
+    state.ad1 = ad1;
+  }
+
   double sampleRate = 44100.0;
   float drive = 0.0f; // 0.0 to 1.0
+  float rampStartDrive = 0.0f;
+  Kernel kernel = Kernel::fast;
+
+  size_t numChannels = 1;
+  size_t maxBlockSize = 0;
+  AdaaState *adaaState = nullptr;
+  SampleType *gainRamp = nullptr;
+  StateArena ownState;
 };
 } // namespace DSP
@@ -0,0 +1,47 @@
+#pragma once
+#include <JuceHeader.h>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace DSP {
+// Process-wide cache of immutable tables (filter coefficients and the like)
+// that every plugin instance would otherwise build and hold its own copy of.
+//
+// The registry only keeps weak references: a table lives as long as some
+// instance holds the shared_ptr returned by get(), and is rebuilt the next
+// time it is asked for after that. get() takes a lock and may build a table,
+// so call it from prepare(), never from the audio thread.
+template <typename Key, typename Table> class SharedTableRegistry {
+public:
+  // Returns the table for `key`, calling build() to make it if no instance
+  // currently holds one. build() must return a Table by value.
+  template <typename BuildFn>
+  std::shared_ptr<const Table> get(const Key &key, BuildFn &&build) {
+    const std::scoped_lock lock(mutex);
+
+    auto &entry = entries[key];
+    if (auto table = entry.lock())
+      return table;
+
+    auto table = std::make_shared<const Table>(build());
+    entry = table;
+    return table;
+  }
+
+  // Number of distinct tables currently alive
+  size_t getNumLiveTables() const {
+    const std::scoped_lock lock(mutex);
+
+    size_t count = 0;
+    for (const auto &[key, entry] : entries)
+      if (!entry.expired())
+        ++count;
+    return count;
+  }
+
+private:
+  mutable std::mutex mutex;
+  std::map<Key, std::weak_ptr<const Table>> entries;
+};
+} // namespace DSP
@@ -0,0 +1,70 @@
+#pragma once
+#include "StateArena.h"
+#include <JuceHeader.h>
+
+namespace DSP {
+// Running maximum over the last `windowLength` values, using a monotonic
+// deque: each value is pushed and popped at most once, so the cost is O(1)
+// amortised per sample regardless of the window length. Storage comes from
+// the owner's StateArena, the deque ends in the hot section: call prepare(),
+// then layoutState(), then reset().
+template <typename SampleType> class SlidingWindowMax {
+public:
+  void prepare(int newWindowLength) {
+    windowLength = juce::jmax(1, newWindowLength);
+
+    // The deque never holds more than windowLength entries
+    capacity = juce::nextPowerOfTwo(windowLength + 1);
+    mask = capacity - 1;
+  }
+
+  void layoutState(StateArena::Layout &layout) {
+    cursor = layout.hot<Cursor>(1);
+    values = layout.cold<SampleType>((size_t)capacity);
+    indices = layout.cold<juce::int64>((size_t)capacity);
+  }
+
+  // A no-op until layoutState() has placed the state
+  void reset() {
+    if (cursor != nullptr)
+      *cursor = {};
+  }
+
+  // Adds `value` as the newest sample and returns the max of the window
+  // ending at it.
+  SampleType push(SampleType value) noexcept {
+    auto head = cursor->head, tail = cursor->tail;
+    const auto counter = cursor->counter;
+
+    // Anything smaller than the new value can never be the max again
+    while (tail != head && values[(size_t)((tail - 1) & mask)] <= value)
+      --tail;
+
+    values[(size_t)(tail & mask)] = value;
+    indices[(size_t)(tail & mask)] = counter;
+    ++tail;
+
+    // Drop the front once it has slid out of the window
+    if (indices[(size_t)(head & mask)] <= counter - windowLength)
+      ++head;
+
+    *cursor = {head, tail, counter + 1};
+    return values[(size_t)(head & mask)];
+  }
+
+private:
+  int windowLength = 1;
+  int capacity = 1;
+
+  SampleType *values = nullptr;
+  juce::int64 *indices = nullptr;
+  juce::int64 mask = 0;
+
+  struct Cursor {
+    juce::int64 head = 0, tail = 0;
+    juce::int64 counter = 0;
+  };
+
+  Cursor *cursor = nullptr;
+};
+} // namespace DSP
@@ -0,0 +1,112 @@
+#pragma once
+#include "FastMath.h"
+#include <JuceHeader.h>
+#include <cmath>
+#include <vector>
+
+namespace DSP {
+// Zero-latency limiter for live monitoring. A fast peak envelope pulls the
+// level down to the ceiling, and a soft-knee clipper catches whatever gets
+// through before the envelope has caught up. There is no lookahead, so it
+// adds no delay, at the cost of some soft clipping on hard transients.
+//
+// Like W1Limiter, the envelope follows the loudest channel and the same gain
+// goes on every channel.
+template <typename SampleType> class SoftClipLimiter {
+public:
+  // Not realtime safe
+  void prepare(const juce::dsp::ProcessSpec &spec) {
+    sampleRate = spec.sampleRate;
+    gainScratch.assign((size_t)spec.maximumBlockSize, SampleType(0));
+
+    // 0.5ms attack, 80ms release
+    attackCoef = (SampleType)std::exp(-1.0 / (0.0005 * sampleRate));
+    releaseCoef = (SampleType)std::exp(-1.0 / (0.08 * sampleRate));
+
+    reset();
+  }
+
+  void reset() { envelope = 0; }
+
+  // Catches up on `numSamples` of silent input that were never processed
+  void skipSilence(size_t numSamples) {
+    envelope *= (SampleType)std::pow((double)releaseCoef, (double)numSamples);
+  }
+
+  void setCeiling(SampleType dB) {
+    ceilingLin = juce::Decibels::decibelsToGain(dB);
+  }
+
+  int getLatencySamples() const { return 0; }
+
+  void process(juce::dsp::AudioBlock<SampleType> &block) {
+    process(block, SampleType(1));
+  }
+
+  // Same, with `inputGain` applied to the input first, in the same pass
+  void process(juce::dsp::AudioBlock<SampleType> &block,
+               SampleType inputGain) {
+    const auto numSamples = block.getNumSamples();
+    const auto numChannels = block.getNumChannels();
+
+    jassert(numSamples <= gainScratch.size());
+
+    // The clipper is linear below the knee and bends smoothly into the
+    // ceiling above it, so it never exceeds the ceiling.
+    const SampleType knee = ceilingLin * kneeRatio;
+    const SampleType kneeRange = ceilingLin - knee;
+
+    auto clip = [knee, kneeRange](SampleType x) {
+      const SampleType a = std::abs(x);
+      if (a <= knee)
+        return x;
+      const SampleType y =
+          knee + kneeRange * FastMath::tanhApprox((a - knee) / kneeRange);
+      return std::copysign(y, x);
+    };
+
+    // Linked peak of every channel, one channel at a time
+    auto *gains = gainScratch.data();
+    std::fill(gains, gains + numSamples, SampleType(0));
+
+    for (size_t ch = 0; ch < numChannels; ++ch) {
+      const auto *src = block.getChannelPointer(ch);
+      for (size_t i = 0; i < numSamples; ++i)
+        gains[i] = std::max(gains[i], std::abs(src[i] * inputGain));
+    }
+
+    // Peak envelope with fast attack and slow release, turning each peak
+    // into the gain for that sample in place
+    SampleType env = envelope;
+
+    for (size_t i = 0; i < numSamples; ++i) {
+      const SampleType peak = gains[i];
+      const SampleType coef = peak > env ? attackCoef : releaseCoef;
+      env = peak + coef * (env - peak);
+
+      gains[i] = env > ceilingLin ? ceilingLin / env : 1;
+    }
+
+    envelope = env;
+
+    for (size_t ch = 0; ch < numChannels; ++ch) {
+      auto *dst = block.getChannelPointer(ch);
+      for (size_t i = 0; i < numSamples; ++i)
+        dst[i] = clip(dst[i] * inputGain * gains[i]);
+    }
+  }
+
+private:
+  // Knee starts ~2dB below ceiling
+  static constexpr SampleType kneeRatio = (SampleType)0.8;
+
+  double sampleRate = 44100.0;
+
+  SampleType ceilingLin = (SampleType)0.891; // -1.0dB
+  SampleType attackCoef = 0;
+  SampleType releaseCoef = 0;
+
+  SampleType envelope = 0;
+  std::vector<SampleType> gainScratch;
+};
+} // namespace DSP
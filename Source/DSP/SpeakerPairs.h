@@ -0,0 +1,40 @@
+#pragma once
+#include "StereoWidener.h"
+#include <JuceHeader.h>
+#include <utility>
+#include <vector>
+
+namespace DSP {
+// Speaker pairs in `layout` for the widener: every left/right pair it has
+// both sides of. Centre, LFE and other unpaired speakers aren't widened.
+// Mono and discrete layouts have no named pairs and get the engine default,
+// channels 0 and 1.
+inline std::vector<ChannelPair>
+getWidenerPairs(const juce::AudioChannelSet &layout) {
+  using Set = juce::AudioChannelSet;
+  const std::pair<Set::ChannelType, Set::ChannelType> speakerPairs[] = {
+      {Set::left, Set::right},
+      {Set::leftCentre, Set::rightCentre},
+      {Set::wideLeft, Set::wideRight},
+      {Set::leftSurround, Set::rightSurround},
+      {Set::leftSurroundSide, Set::rightSurroundSide},
+      {Set::leftSurroundRear, Set::rightSurroundRear},
+      {Set::topFrontLeft, Set::topFrontRight},
+      {Set::topSideLeft, Set::topSideRight},
+      {Set::topRearLeft, Set::topRearRight}};
+
+  std::vector<ChannelPair> pairs;
+
+  for (const auto &[leftType, rightType] : speakerPairs) {
+    const auto left = layout.getChannelIndexForType(leftType);
+    const auto right = layout.getChannelIndexForType(rightType);
+    if (left >= 0 && right >= 0)
+      pairs.push_back({left, right});
+  }
+
+  if (pairs.empty())
+    pairs.push_back({0, 1});
+
+  return pairs;
+}
+} // namespace DSP
@@ -0,0 +1,109 @@
+#pragma once
+#include <JuceHeader.h>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+namespace DSP {
+// One 64-byte aligned block of memory holding the DSP state and scratch of
+// every stage in a VCoreEngine, so an instance's state isn't scattered over
+// the heap.
+//
+// Stages don't allocate buffers themselves. They describe what they need in
+// a layoutState(StateArena::Layout &) member, and build() calls it twice:
+// once to add up the sizes, then again after allocating to hand out the
+// pointers. layoutState() must ask for the same things both times and do
+// nothing else.
+//
+// Layout::hot() is for small state that is touched every sample (filter and
+// integrator state). All of it is packed together at the start of the block.
+// Layout::cold() is for buffers and scratch; each one starts on its own cache
+// line after the hot section.
+class StateArena {
+public:
+  static constexpr size_t alignment = 64;
+
+  class Layout {
+  public:
+    template <typename T> T *hot(size_t count) {
+      return take<T>(hotRegion, count, alignof(T));
+    }
+
+    template <typename T> T *cold(size_t count) {
+      return take<T>(coldRegion, count, alignment);
+    }
+
+  private:
+    friend class StateArena;
+
+    struct Region {
+      char *base = nullptr; // nullptr while sizing
+      size_t used = 0;
+    };
+
+    template <typename T>
+    T *take(Region &region, size_t count, size_t align) {
+      static_assert(std::is_trivially_copyable_v<T> &&
+                        std::is_trivially_destructible_v<T>,
+                    "Arena memory is zero-filled and never destroyed");
+
+      const auto offset = roundUp(region.used, align);
+      region.used = offset + count * sizeof(T);
+      return region.base != nullptr
+                 ? reinterpret_cast<T *>(region.base + offset)
+                 : nullptr;
+    }
+
+    Region hotRegion, coldRegion;
+  };
+
+  StateArena() = default;
+  ~StateArena() { release(); }
+
+  // Sizes, allocates and zero-fills the block, then hands it out through
+  // `layoutFn`. Any previous block is freed. Not realtime safe.
+  template <typename LayoutFn> void build(LayoutFn &&layoutFn) {
+    Layout sizing;
+    layoutFn(sizing);
+
+    const auto hotBytes = roundUp(sizing.hotRegion.used, alignment);
+    const auto totalBytes = hotBytes + sizing.coldRegion.used;
+
+    release();
+    if (totalBytes > 0) {
+      storage = static_cast<char *>(
+          ::operator new(totalBytes, std::align_val_t{alignment}));
+      std::memset(storage, 0, totalBytes);
+    }
+    numBytes = totalBytes;
+
+    Layout placed;
+    placed.hotRegion.base = storage;
+    placed.coldRegion.base = storage + hotBytes;
+    layoutFn(placed);
+
+    jassert(placed.hotRegion.used == sizing.hotRegion.used);
+    jassert(placed.coldRegion.used == sizing.coldRegion.used);
+  }
+
+  // Footprint of the block, in bytes
+  size_t getBytes() const noexcept { return numBytes; }
+
+private:
+  static constexpr size_t roundUp(size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+  }
+
+  void release() {
+    if (storage != nullptr)
+      ::operator delete(storage, std::align_val_t{alignment});
+    storage = nullptr;
+    numBytes = 0;
+  }
+
+  char *storage = nullptr;
+  size_t numBytes = 0;
+
+  JUCE_DECLARE_NON_COPYABLE(StateArena)
+};
+} // namespace DSP
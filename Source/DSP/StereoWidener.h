@@ -1,121 +1,314 @@
 #pragma once
+#include "LinearRamp.h"
+#include "LinkwitzRileyCrossover.h"
+#include "MirroredRingBuffer.h"
+#include "StateArena.h"
 #include <JuceHeader.h>
+#include <memory>
+#include <vector>
 
 namespace DSP {
-class StereoWidener {
+// Channel indices of a left/right pair the widener works on
+struct ChannelPair {
+  int left = 0, right = 1;
+};
+
+// Haas-style widener: a 2kHz crossover splits each channel pair, and the
+// high band comes back on top of the dry signal, delayed by 5ms on the left
+// and 8ms on the right.
+//
+// It widens any number of channel pairs (L/R, the surrounds, the height
+// pairs...); channels that aren't in a pair are left alone. A pair whose
+// right channel doesn't exist widens the left one on its own, which is what
+// a mono layout gets.
+//
+// Pairs go through the crossover two at a time, side by side in four lanes
+// (the same trick as Oversampler's channel pairs). An odd pair out is
+// grouped with itself.
+template <typename SampleType> class StereoWidener {
 public:
-  StereoWidener() {
-    // Crossover at 2kHz
-    lpFilter.setType(juce::dsp::LinkwitzRileyFilterType::lowpass);
-    hpFilter.setType(juce::dsp::LinkwitzRileyFilterType::highpass);
-    lpFilter.setCutoffFrequency(2000.0f);
-    hpFilter.setCutoffFrequency(2000.0f);
+  static constexpr size_t pairsPerGroup = 2;
+
+  // Which channels to widen. Takes effect on the next configure(); not
+  // realtime safe. Defaults to channels 0 and 1.
+  void setChannelPairs(std::vector<ChannelPair> newPairs) {
+    channelPairs = std::move(newPairs);
   }
 
+  // Standalone use: state goes in the widener's own arena
   void prepare(const juce::dsp::ProcessSpec &spec) {
+    configure(spec);
+    ownState.build([this](StateArena::Layout &l) { layoutState(l); });
+    reset();
+  }
+
+  // Sizes and coefficients only. Follow with layoutState() and reset().
+  void configure(const juce::dsp::ProcessSpec &spec) {
     sampleRate = spec.sampleRate;
-    lpFilter.prepare(spec);
-    hpFilter.prepare(spec);
+    resolvePairs((int)spec.numChannels);
+
+    crossovers.assign((pairs.size() + pairsPerGroup - 1) / pairsPerGroup, {});
+    for (auto &crossover : crossovers) {
+      crossover.setCutoffFrequency(2000.0);
+      crossover.prepare(spec.sampleRate);
+    }
+
+    // L: 5ms, R: 8ms
+    delaySamplesL = (int)(0.005 * sampleRate);
+    delaySamplesR = (int)(0.008 * sampleRate);
 
-    // Max delay 20ms
-    delayBuffer.setSize(2, (int)(spec.sampleRate * 0.02) + 1);
-    delayBuffer.clear();
-    writeIndex = 0;
+    // A whole block is written before any of it is read back, so the line
+    // needs room for the longest delay plus one block.
+    maxBlockSize = (int)spec.maximumBlockSize;
+    numLines = pairs.size() * 2;
+    delayLines = std::make_unique<MirroredRingBuffer<SampleType>[]>(numLines);
+    for (size_t line = 0; line < numLines; ++line)
+      delayLines[line].allocate((size_t)(delaySamplesR + maxBlockSize));
   }
 
+  // The delay lines are page-mapped (see MirroredRingBuffer), so only the
+  // crossover state, the write index and the width ramp go in the arena.
+  void layoutState(StateArena::Layout &layout) {
+    writeIndex = layout.hot<size_t>(1);
+    for (auto &crossover : crossovers)
+      crossover.layoutState(layout);
+    widthRamp = layout.cold<SampleType>((size_t)maxBlockSize);
+  }
+
+  // A no-op until layoutState() has placed the state
   void reset() {
-    lpFilter.reset();
-    hpFilter.reset();
-    delayBuffer.clear();
-    writeIndex = 0;
+    if (writeIndex == nullptr)
+      return;
+
+    for (auto &crossover : crossovers)
+      crossover.reset();
+    for (size_t line = 0; line < numLines; ++line)
+      delayLines[line].clear();
+    *writeIndex = 0;
+  }
+
+  // The delayed high band rings out after the longer Haas delay
+  int getTailSamples() const {
+    return crossovers.empty()
+               ? 0
+               : delaySamplesR + crossovers[0].getRingOutSamples();
   }
 
-  void setWidth(float newWidth) {
-    widthAmount = newWidth; // 0.0 to 1.0
+  size_t getDelayLineBytes() const {
+    size_t bytes = 0;
+    for (size_t line = 0; line < numLines; ++line)
+      bytes += delayLines[line].getBytes();
+    return bytes;
   }
 
-  void process(juce::dsp::AudioBlock<float> &block) {
-    if (widthAmount < 0.01f)
+  // Below this the widener leaves the signal alone
+  static constexpr float minimumWidth = 0.01f;
+
+  // Jumps straight to the new width (0.0 to 1.0)
+  void setWidth(float newWidth) { widthAmount = rampStartWidth = newWidth; }
+
+  // Moves to the new width sample by sample over the next process() call.
+  // The widener stays in while either end of the ramp is above
+  // minimumWidth.
+  void rampWidth(float newWidth) { widthAmount = newWidth; }
+
+  void process(juce::dsp::AudioBlock<SampleType> &block) {
+    if (!startWidthRamp(block.getNumSamples()))
       return;
 
-    auto numSamples = block.getNumSamples();
-    auto numChannels = block.getNumChannels();
+    splitBands(block);
 
-    // We need a temporary buffer for HP processing since filters process
-    // in-place and we need both LP and HP separated. Using a scratch buffer or
-    // copying the block.
+    // 2. Wet HP (Width): add the delayed HP band on top
+    const auto numSamples = (int)block.getNumSamples();
+    const auto width = (SampleType)widthAmount;
 
-    // Allocate scratch buffer on stack or member? Member is safer for
-    // performance. For now, let's assume we can allocate a temporary helper.
-    juce::AudioBuffer<float> hpBuffer(numChannels, (int)numSamples);
+    auto addWet = [&](int ch, const SampleType *wet) {
+      auto *dst = block.getChannelPointer((size_t)ch);
+      if (ramping)
+        juce::FloatVectorOperations::addWithMultiply(dst, wet, widthRamp,
+                                                     numSamples);
+      else
+        juce::FloatVectorOperations::addWithMultiply(dst, wet, width,
+                                                     numSamples);
+    };
 
-    // Copy data to hpBuffer
-    for (size_t ch = 0; ch < numChannels; ++ch) {
-      juce::FloatVectorOperations::copy(hpBuffer.getWritePointer((int)ch),
-                                        block.getChannelPointer(ch),
-                                        (int)numSamples);
+    for (size_t p = 0; p < pairs.size(); ++p) {
+      addWet(pairs[p].left, getDelayedL(p));
+      if (pairs[p].right != pairs[p].left)
+        addWet(pairs[p].right, getDelayedR(p));
     }
 
-    // Process LP on original block
-    juce::dsp::ProcessContextReplacing<float> context(block);
-    lpFilter.process(context); // block now has LP only
+    *writeIndex += block.getNumSamples();
+  }
 
-    // Process HP on copy
-    juce::dsp::AudioBlock<float> hpBlock(hpBuffer);
-    juce::dsp::ProcessContextReplacing<float> hpContext(hpBlock);
-    hpFilter.process(hpContext); // hpBuffer now has HP only
+  // Fused form for the engine: the widened signal, times `outputGain`, goes
+  // to `outputs` (one per block channel, which may be the block itself or
+  // the next stage's input) in the same pass that adds the wet band.
+  // Unpaired channels just get the gain.
+  void process(juce::dsp::AudioBlock<SampleType> &block,
+               SampleType *const *outputs, SampleType outputGain) {
+    const auto numSamples = block.getNumSamples();
 
-    // Apply delay to HP buffer and add back to block
-    // L: 5ms, R: 8ms
-    int delaySamplesL = (int)(0.005 * sampleRate);
-    int delaySamplesR = (int)(0.008 * sampleRate);
+    auto applyGain = [&](size_t ch) {
+      juce::FloatVectorOperations::multiply(outputs[ch],
+                                            block.getChannelPointer(ch),
+                                            outputGain, (int)numSamples);
+    };
+
+    if (!startWidthRamp(numSamples)) {
+      for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+        applyGain(ch);
+      return;
+    }
+
+    for (auto ch : unpairedChannels)
+      if ((size_t)ch < block.getNumChannels())
+        applyGain((size_t)ch);
 
-    auto *delayL = delayBuffer.getWritePointer(0);
-    auto *delayR = delayBuffer.getWritePointer(1);
-    int delayLen = delayBuffer.getNumSamples();
+    splitBands(block);
 
-    const auto *srcL = hpBuffer.getReadPointer(0);
-    const auto *srcR = hpBuffer.getReadPointer(1 > numChannels - 1 ? 0 : 1);
+    const auto width = (SampleType)widthAmount;
 
-    auto *dstL = block.getChannelPointer(0);
-    auto *dstR = block.getChannelPointer(1 > numChannels - 1 ? 0 : 1);
+    auto addWet = [&](int ch, const SampleType *wet) {
+      const auto *dry = block.getChannelPointer((size_t)ch);
+      auto *out = outputs[ch];
 
-    // We need to match writeIndex across calls, so use member
-    int localWriteIndex = writeIndex;
+      if (ramping)
+        for (size_t i = 0; i < numSamples; ++i)
+          out[i] = (dry[i] + widthRamp[i] * wet[i]) * outputGain;
+      else
+        for (size_t i = 0; i < numSamples; ++i)
+          out[i] = (dry[i] + width * wet[i]) * outputGain;
+    };
 
-    for (size_t i = 0; i < numSamples; ++i) {
-      // Write to delay line
-      delayL[localWriteIndex] = srcL[i];
-      delayR[localWriteIndex] = srcR[i];
+    for (size_t p = 0; p < pairs.size(); ++p) {
+      addWet(pairs[p].left, getDelayedL(p));
+      if (pairs[p].right != pairs[p].left)
+        addWet(pairs[p].right, getDelayedR(p));
+    }
+
+    *writeIndex += numSamples;
+  }
 
-      // Read from delay line
-      int readIndexL = (localWriteIndex - delaySamplesL + delayLen) % delayLen;
-      int readIndexR = (localWriteIndex - delaySamplesR + delayLen) % delayLen;
+private:
+  using Crossover = LinkwitzRileyCrossover<SampleType, pairsPerGroup * 2>;
+  static constexpr size_t numLanes = Crossover::numLanes;
 
-      float delayedL = delayL[readIndexL];
-      float delayedR = delayR[readIndexR];
+  // Drops pairs that don't fit the layout and points a missing right
+  // channel at the left one
+  void resolvePairs(int numChannels) {
+    pairs.clear();
+    unpairedChannels.clear();
 
-      // Add to LP signal in dst (block)
-      // We must add the DRY HP signal back, otherwise we lose high frequencies!
-      // Result = LP (already in dst) + Dry HP + Wet HP (Width)
+    std::vector<bool> paired((size_t)juce::jmax(0, numChannels), false);
 
-      dstL[i] += srcL[i] + (delayedL * widthAmount);
-      dstR[i] += srcR[i] + (delayedR * widthAmount);
+    for (auto pair : channelPairs) {
+      if (pair.left < 0 || pair.left >= numChannels)
+        continue;
+      if (pair.right < 0 || pair.right >= numChannels)
+        pair.right = pair.left;
 
-      localWriteIndex = (localWriteIndex + 1) % delayLen;
+      // A channel can only be in one pair
+      jassert(!paired[(size_t)pair.left] && !paired[(size_t)pair.right]);
+      paired[(size_t)pair.left] = paired[(size_t)pair.right] = true;
+      pairs.push_back(pair);
     }
 
-    writeIndex = localWriteIndex;
+    for (int ch = 0; ch < numChannels; ++ch)
+      if (!paired[(size_t)ch])
+        unpairedChannels.push_back(ch);
+  }
+
+  // Fills the width ramp if the width is moving. False when the widener is
+  // out for the whole block.
+  bool startWidthRamp(size_t numSamples) {
+    const auto startWidth = rampStartWidth;
+    rampStartWidth = widthAmount;
+    ramping = startWidth != widthAmount;
+
+    if (widthAmount < minimumWidth && startWidth < minimumWidth)
+      return false;
+
+    jassert(numSamples <= (size_t)maxBlockSize);
+    if (ramping)
+      fillLinearRamp(widthRamp, (SampleType)startWidth,
+                     (SampleType)widthAmount, numSamples);
+    return true;
+  }
+
+  const SampleType *getDelayedL(size_t pair) const {
+    return delayLines[pair * 2].window(*writeIndex - (size_t)delaySamplesL);
+  }
+
+  const SampleType *getDelayedR(size_t pair) const {
+    return delayLines[pair * 2 + 1].window(*writeIndex -
+                                           (size_t)delaySamplesR);
+  }
+
+  void splitBands(juce::dsp::AudioBlock<SampleType> &block) {
+    const auto numSamples = block.getNumSamples();
+    jassert(numSamples <= (size_t)maxBlockSize);
+
+    for (size_t group = 0; group < crossovers.size(); ++group) {
+      // Lanes are left, right of the first pair, then of the second. A
+      // missing right channel or second pair repeats the lanes before it,
+      // which compute the same thing, so writing it twice is harmless.
+      SampleType *dst[numLanes];
+      SampleType *hp[numLanes];
+
+      for (size_t k = 0; k < pairsPerGroup; ++k) {
+        const auto p = juce::jmin(group * pairsPerGroup + k, pairs.size() - 1);
+        dst[k * 2] = block.getChannelPointer((size_t)pairs[p].left);
+        dst[k * 2 + 1] = block.getChannelPointer((size_t)pairs[p].right);
+        hp[k * 2] = delayLines[p * 2].window(*writeIndex);
+        hp[k * 2 + 1] = delayLines[p * 2 + 1].window(*writeIndex);
+      }
+
+      // 1. Band split. LP + dry HP go straight back into the block and the
+      // HP band into the delay lines. Ring windows are contiguous, so this
+      // is one straight pass with no wraparound.
+      auto &crossover = crossovers[group];
+      SampleType in[numLanes], lp[numLanes], high[numLanes];
+
+      for (size_t i = 0; i < numSamples; ++i) {
+        for (size_t lane = 0; lane < numLanes; ++lane)
+          in[lane] = dst[lane][i];
+
+        crossover.processSample(in, lp, high);
+
+        // We must keep the DRY HP signal, otherwise we lose high
+        // frequencies!
+        for (size_t lane = 0; lane < numLanes; ++lane) {
+          dst[lane][i] = lp[lane] + high[lane];
+          hp[lane][i] = high[lane];
+        }
+      }
+    }
+
+    for (size_t line = 0; line < numLines; ++line)
+      delayLines[line].written(*writeIndex, numSamples);
   }
 
-private:
   double sampleRate = 44100.0;
   float widthAmount = 0.0f;
+  float rampStartWidth = 0.0f;
+  bool ramping = false;
+  int delaySamplesL = 0;
+  int delaySamplesR = 0;
+  int maxBlockSize = 0;
+
+  std::vector<ChannelPair> channelPairs = {{0, 1}};
+  std::vector<ChannelPair> pairs; // The ones that fit the layout
+  std::vector<int> unpairedChannels;
 
-  juce::dsp::LinkwitzRileyFilter<float> lpFilter;
-  juce::dsp::LinkwitzRileyFilter<float> hpFilter;
+  std::vector<Crossover> crossovers; // One per group of pairs
+  SampleType *widthRamp = nullptr;
+  StateArena ownState;
 
-  juce::AudioBuffer<float> delayBuffer;
-  int writeIndex = 0;
+  // HP band, L and R of each pair. The ring buffers can't be moved, so no
+  // vector.
+  size_t numLines = 0;
+  std::unique_ptr<MirroredRingBuffer<SampleType>[]> delayLines;
+  size_t *writeIndex = nullptr; // In the arena's hot section
 };
 } // namespace DSP
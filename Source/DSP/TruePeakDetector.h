@@ -0,0 +1,102 @@
+#pragma once
+#include "StateArena.h"
+#include <JuceHeader.h>
+
+namespace DSP {
+// Inter-sample peak estimator for the limiter's detector path, following
+// ITU-R BS.1770-4 Annex 2: 4x upsampling with the 48-tap polyphase FIR from
+// the recommendation (12 taps per phase), then the absolute max of the four
+// phases and the original sample. Only peaks are produced; the audio path is
+// never resampled.
+//
+// The interpolated points for output sample n lie between input samples
+// n - latency and n - latency + 1, so the caller has to delay the audio by
+// `latency` samples to line it up.
+//
+// History storage comes from the owner's StateArena: call prepare(), then
+// layoutState(), then reset().
+template <typename SampleType> class TruePeakDetector {
+public:
+  static constexpr int numPhases = 4;
+  static constexpr int tapsPerPhase = 12;
+  static constexpr int latency = 6;
+
+  void prepare(int maximumBlockSize, int newNumChannels) {
+    preparedChannels = juce::jmax(1, newNumChannels);
+    historySize = (size_t)(maximumBlockSize + tapsPerPhase - 1);
+  }
+
+  void layoutState(StateArena::Layout &layout) {
+    history = layout.cold<SampleType>(historySize * (size_t)preparedChannels);
+  }
+
+  // A no-op until layoutState() has placed the history
+  void reset() {
+    if (history == nullptr)
+      return;
+
+    std::fill(history, history + historySize * (size_t)preparedChannels,
+              SampleType(0));
+  }
+
+  // peaks[i] = max over all channels of the true-peak estimate around input
+  // sample i - latency.
+  void process(const SampleType *const *channels, size_t numChannels,
+               SampleType *peaks, size_t numSamples) {
+    constexpr size_t historyLength = tapsPerPhase - 1;
+
+    jassert(numChannels <= (size_t)preparedChannels);
+    jassert(numSamples + historyLength <= historySize);
+
+    juce::FloatVectorOperations::clear(peaks, (int)numSamples);
+
+    for (size_t ch = 0; ch < numChannels; ++ch) {
+      // Past samples followed by the new block, so every tap is a plain
+      // offset read without wraparound.
+      auto *x = history + ch * historySize;
+      juce::FloatVectorOperations::copy(x + historyLength, channels[ch],
+                                        (int)numSamples);
+
+      for (size_t i = 0; i < numSamples; ++i) {
+        const auto *newest = x + i + historyLength;
+
+        // Original sample at the same position as the interpolated ones
+        auto peak = std::abs(newest[-latency]);
+
+        for (int phase = 0; phase < numPhases; ++phase) {
+          SampleType sum = 0;
+          for (int tap = 0; tap < tapsPerPhase; ++tap)
+            sum += (SampleType)coefficients[phase][tap] * newest[-tap];
+          peak = std::max(peak, std::abs(sum));
+        }
+
+        peaks[i] = std::max(peaks[i], peak);
+      }
+
+      // Keep the tail as history for the next block
+      std::copy(x + numSamples, x + numSamples + historyLength, x);
+    }
+  }
+
+private:
+  // ITU-R BS.1770-4, Annex 2, Table 1. Multiples of 2^-13, so float holds
+  // them exactly for either sample type.
+  static constexpr float coefficients[numPhases][tapsPerPhase] = {
+      {0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f,
+       -0.0594482421875f, 0.1373291015625f, 0.9721679687500f, -0.1022949218750f,
+       0.0476074218750f, -0.0266113281250f, 0.0148925781250f, -0.0083007812500f},
+      {-0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f,
+       -0.1665039062500f, 0.4650878906250f, 0.7797851562500f, -0.2003173828125f,
+       0.1015625000000f, -0.0582275390625f, 0.0330810546875f, -0.0189208984375f},
+      {-0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f,
+       -0.2003173828125f, 0.7797851562500f, 0.4650878906250f, -0.1665039062500f,
+       0.0891113281250f, -0.0517578125000f, 0.0292968750000f, -0.0291748046875f},
+      {-0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f,
+       -0.1022949218750f, 0.9721679687500f, 0.1373291015625f, -0.0594482421875f,
+       0.0332031250000f, -0.0196533203125f, 0.0109863281250f, 0.0017089843750f}};
+
+  int preparedChannels = 1;
+  size_t historySize = 0;
+  SampleType *history = nullptr; // historySize per channel
+};
+} // namespace DSP
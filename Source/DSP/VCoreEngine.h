@@ -1,113 +1,651 @@
 #pragma once
+#include "../Diagnostics/RealtimeCheck.h"
+#include "BypassDelay.h"
+#include "LinearRamp.h"
+#include "ModeSettings.h"
+#include "Oversampler.h"
 #include "Saturator.h"
+#include "SoftClipLimiter.h"
+#include "StateArena.h"
 #include "StereoWidener.h"
 #include "W1Limiter.h"
 #include <JuceHeader.h>
+#include <array>
+#include <utility>
+#include <vector>
 
 namespace DSP {
-class VCoreEngine {
+// The whole chain, in float or double. Every stage is templated on the same
+// sample type; the double engine has the same latency and tail, and its SIMD
+// kernels get half as many lanes per register.
+template <typename SampleType> class VCoreEngine {
 public:
-  VCoreEngine()
-      : oversampling(2, 2,
-                     juce::dsp::Oversampling<
-                         float>::filterHalfBandPolyphaseIIR) // Factor 4x (2^2)
-  {}
+  static constexpr size_t maxOversamplingFactorLog2 =
+      Oversampler<SampleType>::maxFactorLog2;
+
+  // process() cuts host buffers into chunks of at most this many samples, so
+  // any host block size works and the stages' working set stays in cache.
+  // Every stage is prepared for this length (times the oversampling factor),
+  // not for the host's maximum block size.
+  static constexpr int subBlockSize = 64;
+
+  // Takes effect on the next prepare()
+  void setOversampling(size_t newFactorLog2, OversamplingFilter newFilter) {
+    jassert(newFactorLog2 <= maxOversamplingFactorLog2);
+    oversamplingFactorLog2 =
+        juce::jmin(newFactorLog2, maxOversamplingFactorLog2);
+    oversamplingFilter = newFilter;
+  }
+
+  // Live monitoring mode: no oversampling, the ADAA saturator and the
+  // zero-lookahead SoftClipLimiter. The only latency left is the ADAA
+  // kernel's half sample, topped up to one whole sample so the host can
+  // compensate it and the bypass path lines up.
+  // Overrides the oversampling setting. Takes effect on the next prepare().
+  void setLiveMode(bool shouldBeLive) { liveMode = shouldBeLive; }
+  bool isLiveMode() const { return liveMode; }
+
+  // Channel pairs the widener works on; the limiters and the saturator
+  // always cover every channel. Pairs that don't fit the channel count are
+  // skipped. Defaults to channels 0 and 1. Takes effect on the next
+  // prepare().
+  void setWidenerPairs(std::vector<ChannelPair> pairs) {
+    widener.setChannelPairs(std::move(pairs));
+  }
 
   void prepare(const juce::dsp::ProcessSpec &spec) {
     sampleRate = spec.sampleRate;
+    numChannels = juce::jmax((size_t)1, (size_t)spec.numChannels);
 
-    oversampling.reset();
-    oversampling.initProcessing(spec.maximumBlockSize);
+    // ADAA puts out the average of tanh between consecutive samples, which
+    // is half a sample late at the rate it runs at. The oversampler counts
+    // it in with its own filters' fraction, so the Thiran allpass rounds the
+    // whole chain up to whole samples and the chain lines up with the bypass
+    // delay when the two are crossfaded.
+    const auto kernel = liveMode ? SaturatorKernel::adaa : saturatorKernel;
+    oversampling.configure(spec.numChannels, getOversamplingFactorLog2(),
+                           getOversamplingFilter(), (size_t)subBlockSize,
+                           kernel == SaturatorKernel::adaa ? 0.5 : 0.0);
+
+    auto subBlockSpec = spec;
+    subBlockSpec.maximumBlockSize = (juce::uint32)subBlockSize;
+
+    // Everything after the upsampler sees blocks that are `factor` times
+    // longer than a sub-block, so size the stages for that.
+    const auto factor = (juce::uint32)oversampling.getOversamplingFactor();
+
+    auto osSpec = subBlockSpec;
+    osSpec.sampleRate *= (double)factor;
+    osSpec.maximumBlockSize *= factor;
+
+    // Only the saturator is nonlinear enough to alias, so it is the only
+    // stage that runs oversampled.
+    saturator.configure(osSpec);
+
+    // The widener is linear, so it gains nothing from the higher rate.
+    widener.configure(subBlockSpec);
+
+    // The limiters only apply gain, so they run at the host rate after
+    // downsampling. W1Limiter's true-peak detector catches the inter-sample
+    // peaks that the oversampled path would otherwise have seen.
+    limiter.configure(subBlockSpec);
+    liveLimiter.prepare(subBlockSpec);
+
+    // All stage state and scratch in one block, the per-sample filter state
+    // of every stage packed together at the front
+    stateArena.build([this](StateArena::Layout &layout) {
+      oversampling.layoutState(layout);
+      saturator.layoutState(layout);
+      widener.layoutState(layout);
+      limiter.layoutState(layout);
+      channelScratch = layout.cold<SampleType *>(numChannels);
+      gainRamp = layout.cold<SampleType>((size_t)subBlockSize);
+      wetRamp = layout.cold<SampleType>((size_t)subBlockSize);
+      dryRamp = layout.cold<SampleType>((size_t)subBlockSize);
+    });
+
+    const auto limiterLatency = liveMode ? liveLimiter.getLatencySamples()
+                                         : limiter.getLatencySamples();
+    latencySamples = oversampling.getLatencySamples() + limiterLatency;
+
+    // Impulse response lengths add up along the chain. The saturator and
+    // the limiters are memoryless apart from the lookahead delay (ADAA
+    // holds one sample).
+    tailSamples = oversampling.getTailSamples() + widener.getTailSamples() +
+                  limiterLatency + 1;
+
+    bypassDelay.prepare(latencySamples, (size_t)subBlockSize, numChannels);
+
+    prepared = true;
+    reset();
+    saturator.setKernel(kernel);
+    selectProcessFunction();
+  }
 
-    auto osSpec = spec;
-    osSpec.sampleRate *= 4.0; // 4x Oversampling
+  // Memory held by this instance, in bytes. The shared tables are counted
+  // in full, but exist once per process however many instances use them.
+  // Only valid after prepare().
+  struct MemoryFootprint {
+    size_t stateArenaBytes = 0;  // All stage state and scratch
+    size_t delayLineBytes = 0;   // Page-mapped delay lines
+    size_t sharedTableBytes = 0; // Read-only coefficients
+  };
 
-    saturator.prepare(osSpec);
-    widener.prepare(osSpec);
-    limiter.prepare(osSpec);
+  MemoryFootprint getMemoryFootprint() const {
+    MemoryFootprint footprint;
+    footprint.stateArenaBytes = stateArena.getBytes();
+    footprint.delayLineBytes = widener.getDelayLineBytes() +
+                               limiter.getDelayLineBytes() +
+                               bypassDelay.getDelayLineBytes();
+    footprint.sharedTableBytes = oversampling.getTableBytes();
+    return footprint;
   }
 
   void reset() {
+    // Stage state lives in the arena, which only exists after prepare()
+    if (!prepared)
+      return;
+
+    // Nothing left to glide from
+    if (morphing)
+      setParameters(currentSettings);
+
+    resetChain();
+    bypassDelay.reset();
+    chainIsStale = false;
+
+    silentSamples = 0;
+    sleptSamples = 0;
+    asleep = false;
+  }
+
+  // Total delay through the engine in host samples: the oversampling
+  // filters plus the limiter lookahead. Only valid after prepare().
+  // The bypass path is delayed by the same amount.
+  int getLatencySamples() const { return prepared ? latencySamples : 0; }
+
+  // How long the output keeps going after the input goes silent, in host
+  // samples. Only valid after prepare().
+  int getTailSamples() const { return prepared ? tailSamples : 0; }
+
+  // Input below this counts as silence for the auto-sleep in process()
+  static constexpr float silenceThreshold = 1.0e-6f; // -120 dBFS
+
+  // True while process() is skipping the DSP on silent input
+  bool isAsleep() const { return asleep; }
+
+  // On by default. Off, process() runs the DSP on silence too, which is the
+  // reference a sleeping engine is checked against.
+  void setAutoSleep(bool shouldSleep) { autoSleep = shouldSleep; }
+  bool isAutoSleep() const { return autoSleep; }
+
+  static constexpr int numModes = DSP::numModes;
+  using ModeSettings = DSP::ModeSettings;
+
+  static ModeSettings getModeSettings(int modeIndex) {
+    return DSP::getModeSettings(modeIndex);
+  }
+
+  void setParameters(int modeIndex) {
+    setParameters(getModeSettings(modeIndex));
+  }
+
+  // Jumps straight to the settings, cancelling any morph. Fine offline and
+  // before playback starts; while audio is playing, morphTo() avoids the
+  // click.
+  void setParameters(const ModeSettings &settings) {
+    currentSettings = settings;
+    morphing = false;
+
+    saturator.setDrive(settings.saturationDrive);
+    widener.setWidth(settings.width);
+    limiter.setThreshold(settings.thresholdDB);
+
+    currentMakeupGain =
+        (SampleType)juce::Decibels::decibelsToGain(settings.makeupGainDB);
+    rampStartMakeupGain = currentMakeupGain;
+    selectProcessFunction();
+  }
+
+  // How long morphTo() takes to get there. Used by the next morphTo().
+  void setMorphTime(double seconds) { morphSeconds = juce::jmax(0.0, seconds); }
+
+  // Glides from wherever the engine is to the settings over the morph time:
+  // drive, width and makeup gain move sample by sample, and going into or
+  // out of bypass crossfades the chain with the latency-matched dry signal.
+  // A new target in the middle of a morph starts from where that one had
+  // got to. Realtime safe.
+  void morphTo(const ModeSettings &settings) {
+    if (settings == currentSettings)
+      return;
+
+    auto from = getMorphPoint(morphPosition);
+    MorphPoint to{settings, settings.bypass ? 0.0f : 1.0f};
+
+    if (!prepared || morphSeconds <= 0.0 || (from.wet == 0 && to.wet == 0)) {
+      setParameters(settings);
+      return;
+    }
+
+    // The chain settings only matter on the side where it's heard
+    to.settings.bypass = from.settings.bypass = false;
+    if (to.wet == 0)
+      to.settings = from.settings;
+    if (from.wet == 0)
+      from.settings = to.settings;
+
+    morphStart = from;
+    morphTarget = to;
+    morphLength = juce::jmax(1, juce::roundToInt(morphSeconds * sampleRate));
+
+    // Out of bypass, the chain starts from silence, and its output isn't
+    // settled until the delays and filters have filled up (the widener's
+    // wet band only arrives after its Haas delay). Let it run for the tail
+    // first, so what fades in is the signal and not its start-up.
+    morphPosition = from.wet == 0 ? -tailSamples : 0;
+
+    currentSettings = settings;
+    morphing = true;
+    selectProcessFunction();
+  }
+
+  bool isMorphing() const { return morphing; }
+
+  // Fused: the widener's wet-band pass also applies the makeup gain and
+  // writes straight into the limiter's input, instead of each stage making
+  // its own pass over the sub-block. Staged runs them one after the other,
+  // as a reference. Both give the same output to within rounding.
+  void setFusedChain(bool shouldFuse) {
+    fusedChain = shouldFuse;
+    selectProcessFunction();
+  }
+  bool isFusedChain() const { return fusedChain; }
+
+  // Ignored in live mode, which always uses the ADAA kernel. Takes effect
+  // on the next prepare(), since ADAA changes the latency.
+  void setSaturatorKernel(SaturatorKernel kernel) { saturatorKernel = kernel; }
+
+  // The factor/filter the engine runs with, taking live mode into account
+  size_t getOversamplingFactor() const {
+    return (size_t)1 << getOversamplingFactorLog2();
+  }
+
+  size_t getOversamplingFactorLog2() const {
+    return liveMode ? 0 : oversamplingFactorLog2;
+  }
+
+  OversamplingFilter getOversamplingFilter() const {
+    return liveMode ? OversamplingFilter::iir : oversamplingFilter;
+  }
+
+  // Accepts any number of samples, regardless of the maximumBlockSize given
+  // to prepare(), but no more channels than its numChannels: any beyond
+  // that would come out unprocessed and a latency early, so they assert and
+  // come out silent.
+  // Once the input has been silent for longer than the tail, the output is
+  // silent too and the DSP is skipped altogether; the first sub-block with
+  // any signal in it wakes the engine up again.
+  void process(juce::AudioBuffer<SampleType> &buffer) {
+    processSubBlocks(buffer, &VCoreEngine::processOrSleep);
+  }
+
+  // Host bypass: only the latency-matched delay, whatever the mode
+  void processBypassed(juce::AudioBuffer<SampleType> &buffer) {
+    processSubBlocks(buffer, &VCoreEngine::processBypass);
+  }
+
+private:
+  using SubBlockFunction =
+      void (VCoreEngine::*)(juce::dsp::AudioBlock<SampleType> &);
+
+  void processSubBlocks(juce::AudioBuffer<SampleType> &buffer,
+                        SubBlockFunction function) {
+    jassert(prepared);
+    jassert((size_t)buffer.getNumChannels() <= numChannels);
+
+    const auto channels =
+        juce::jmin((size_t)buffer.getNumChannels(), numChannels);
+    for (auto ch = (int)channels; ch < buffer.getNumChannels(); ++ch)
+      buffer.clear(ch, 0, buffer.getNumSamples());
+
+    const auto hostBlock =
+        juce::dsp::AudioBlock<SampleType>(buffer).getSubsetChannelBlock(
+            0, channels);
+    const auto numSamples = hostBlock.getNumSamples();
+
+    for (size_t start = 0; start < numSamples; start += subBlockSize) {
+      auto block = hostBlock.getSubBlock(
+          start, juce::jmin((size_t)subBlockSize, numSamples - start));
+      (this->*function)(block);
+    }
+  }
+
+  // processChain() for every combination of its flags, indexed by the
+  // flags as bits: [live][fused][widen][makeup]
+  template <size_t... index>
+  static constexpr std::array<SubBlockFunction, sizeof...(index)>
+  makeChainFunctions(std::index_sequence<index...>) {
+    return {&VCoreEngine::processChain<(index & 8) != 0, (index & 4) != 0,
+                                       (index & 2) != 0, (index & 1) != 0>...};
+  }
+
+  // Picks the process function for the current settings. Each combination
+  // of active stages is its own instantiation of processChain(), so the
+  // per-block branches on the mode are resolved at compile time.
+  void selectProcessFunction() {
+    if (morphing) {
+      processFunction = &VCoreEngine::processMorph;
+      return;
+    }
+
+    if (currentSettings.bypass) {
+      processFunction = &VCoreEngine::processBypass;
+      return;
+    }
+
+    static constexpr auto chains =
+        makeChainFunctions(std::make_index_sequence<16>());
+
+    const auto widen =
+        currentSettings.width >= StereoWidener<SampleType>::minimumWidth;
+    const auto makeup = currentSettings.makeupGainDB != 0.0f;
+    processFunction = chains[(liveMode ? 8 : 0) + (fusedChain ? 4 : 0) +
+                             (widen ? 2 : 0) + (makeup ? 1 : 0)];
+  }
+
+  void resetChain() {
     oversampling.reset();
     saturator.reset();
     widener.reset();
     limiter.reset();
+    liveLimiter.reset();
   }
 
-  void setParameters(int modeIndex) {
-    float thresholdDB = 0.0f;
-    float width = 0.0f;
-    float saturationDrive = 0.0f;
-    float makeupGainDB = 0.0f;
-
-    switch (modeIndex) {
-    case 0: // BYPASS / CLEAN
-      thresholdDB = 0.0f;
-      width = 0.0f;
-      saturationDrive = 0.0f;
-      makeupGainDB = 0.0f;
-      break;
-    case 1: // NATURAL
-      thresholdDB = -3.0f;
-      width = 0.10f;
-      saturationDrive = 0.1f;
-      makeupGainDB = 2.0f;
-      break;
-    case 2: // LIVE / STREAM
-      thresholdDB = -6.0f;
-      width = 0.25f;
-      saturationDrive = 0.2f;
-      makeupGainDB = 5.0f;
-      break;
-    case 3: // VOCAL / POWER
-      thresholdDB = -9.0f;
-      width = 0.40f;
-      saturationDrive = 0.3f;
-      makeupGainDB = 8.0f;
-      break;
-    case 4: // BROADCAST
-      thresholdDB = -12.0f;
-      width = 0.55f;
-      saturationDrive = 0.4f;
-      makeupGainDB = 11.0f;
-      break;
-    }
-
-    saturator.setDrive(saturationDrive);
-    widener.setWidth(width);
-    limiter.setThreshold(thresholdDB);
-
-    currentMakeupGain = juce::Decibels::decibelsToGain(makeupGainDB);
-  }
-
-  void process(juce::AudioBuffer<float> &buffer) {
-    juce::dsp::AudioBlock<float> block(buffer);
-    auto osBlock = oversampling.processSamplesUp(block);
+  void processOrSleep(juce::dsp::AudioBlock<SampleType> &block) {
+    if (autoSleep && isSilent(block)) {
+      if (silentSamples >= tailSamples) {
+        asleep = true;
+        sleptSamples += block.getNumSamples();
+        block.clear();
+        return;
+      }
+      silentSamples += (int)block.getNumSamples();
+    } else {
+      silentSamples = 0;
+      if (asleep)
+        wake();
+    }
+
+    (this->*processFunction)(block);
+  }
+
+  void wake() {
+    // Everything has rung out by now, so the filters and delay lines start
+    // from clean state rather than whatever denormal-sized leftovers they
+    // hold. The limiter gains were still releasing while asleep, though.
+    oversampling.reset();
+    saturator.reset();
+    widener.reset();
+    bypassDelay.reset();
+    limiter.skipSilence(sleptSamples);
+    liveLimiter.skipSilence(sleptSamples);
+
+    sleptSamples = 0;
+    asleep = false;
+  }
+
+  static bool isSilent(const juce::dsp::AudioBlock<SampleType> &block) {
+    const auto numSamples = (int)block.getNumSamples();
+
+    for (size_t ch = 0; ch < block.getNumChannels(); ++ch) {
+      const auto range = juce::FloatVectorOperations::findMinAndMax(
+          block.getChannelPointer(ch), numSamples);
+      if (-range.getStart() > silenceThreshold ||
+          range.getEnd() > silenceThreshold)
+        return false;
+    }
+
+    return true;
+  }
+
+  void processBypass(juce::dsp::AudioBlock<SampleType> &block) {
+    VCORE_REALTIME_STAGE("Bypass delay");
+    bypassDelay.process(block);
+
+    // The stages didn't see this audio, so their state no longer follows
+    // the input. Start them from silence when the chain is back on.
+    chainIsStale = true;
+  }
+
+  template <bool live, bool fused, bool widen, bool makeup>
+  void processChain(juce::dsp::AudioBlock<SampleType> &block) {
+    if (chainIsStale) {
+      resetChain();
+      chainIsStale = false;
+    }
+
+    // Keep the bypass line current so switching to bypass is seamless
+    bypassDelay.push(block);
+
+    juce::dsp::AudioBlock<SampleType> osBlock;
+    {
+      VCORE_REALTIME_STAGE("Oversampler (up)");
+      osBlock = oversampling.processSamplesUp(block);
+    }
 
     // 1. Saturation
-    juce::dsp::ProcessContextReplacing<float> satContext(osBlock);
-    saturator.process(satContext);
+    {
+      VCORE_REALTIME_STAGE("Saturator");
+      juce::dsp::ProcessContextReplacing<SampleType> satContext(osBlock);
+      saturator.process(satContext);
+    }
 
-    // 2. Stereo Widener (Now accepts block)
-    widener.process(osBlock);
+    {
+      VCORE_REALTIME_STAGE("Oversampler (down)");
+      oversampling.processSamplesDown(block);
+    }
+
+    // Everything from here on is at the host rate
+    if constexpr (fused)
+      processHostRateFused<live, widen, makeup>(block);
+    else
+      processHostRateStaged<live, widen, makeup>(block);
+  }
+
+  template <bool live, bool widen, bool makeup>
+  void processHostRateStaged(juce::dsp::AudioBlock<SampleType> &block) {
+    // 2. Stereo Widener
+    if constexpr (widen) {
+      VCORE_REALTIME_STAGE("StereoWidener");
+      widener.process(block);
+    }
 
     // 3. Makeup Gain
-    osBlock.multiplyBy(currentMakeupGain);
+    if constexpr (makeup) {
+      VCORE_REALTIME_STAGE("Makeup gain");
+      applyMakeupGain(block);
+    }
+
+    // 4. Limiter
+    if constexpr (live) {
+      VCORE_REALTIME_STAGE("SoftClipLimiter");
+      liveLimiter.process(block);
+    } else {
+      VCORE_REALTIME_STAGE("W1Limiter");
+      limiter.process(block);
+    }
+  }
+
+  // Same stages, fewer passes. With the widener on, its wet-band pass
+  // applies the makeup gain and writes the result where the limiter reads
+  // its input (the lookahead line, or the block for the live limiter).
+  // Without it, the limiter applies the gain as it takes the input.
+  template <bool live, bool widen, bool makeup>
+  void processHostRateFused(juce::dsp::AudioBlock<SampleType> &block) {
+    const auto gain = makeup ? currentMakeupGain : SampleType(1);
 
-    // 4. Limiter (Now accepts block)
-    limiter.process(osBlock);
+    if constexpr (live) {
+      if constexpr (widen) {
+        VCORE_REALTIME_STAGE("StereoWidener");
+        const auto channels = juce::jmin(block.getNumChannels(), numChannels);
+        for (size_t ch = 0; ch < channels; ++ch)
+          channelScratch[ch] = block.getChannelPointer(ch);
+        widener.process(block, channelScratch, gain);
+      }
 
-    oversampling.processSamplesDown(block);
+      VCORE_REALTIME_STAGE("SoftClipLimiter");
+      liveLimiter.process(block, widen ? SampleType(1) : gain);
+    } else if constexpr (widen) {
+      {
+        VCORE_REALTIME_STAGE("StereoWidener");
+        widener.process(block, limiter.getInputWindows(), gain);
+      }
+
+      VCORE_REALTIME_STAGE("W1Limiter");
+      limiter.processWrittenInput(block);
+    } else {
+      VCORE_REALTIME_STAGE("W1Limiter");
+      limiter.process(block, gain);
+    }
+  }
+
+  void applyMakeupGain(juce::dsp::AudioBlock<SampleType> &block) {
+    if (rampStartMakeupGain == currentMakeupGain) {
+      block.multiplyBy(currentMakeupGain);
+      return;
+    }
+
+    const auto numSamples = block.getNumSamples();
+    fillLinearRamp(gainRamp, rampStartMakeupGain, currentMakeupGain,
+                   numSamples);
+    rampStartMakeupGain = currentMakeupGain;
+
+    for (size_t ch = 0; ch < block.getNumChannels(); ++ch)
+      juce::FloatVectorOperations::multiply(block.getChannelPointer(ch),
+                                            gainRamp, (int)numSamples);
+  }
+
+  // Where a morph is `position` samples in: the chain settings, and how much
+  // of the output is the chain rather than the bypass delay
+  struct MorphPoint {
+    ModeSettings settings;
+    float wet = 1.0f;
+  };
+
+  MorphPoint getMorphPoint(int position) const {
+    if (!morphing)
+      return {currentSettings, currentSettings.bypass ? 0.0f : 1.0f};
+
+    const auto t =
+        juce::jlimit(0.0f, 1.0f, (float)position / (float)morphLength);
+    auto glide = [t](float from, float to) { return from + (to - from) * t; };
+
+    const auto &from = morphStart.settings;
+    const auto &to = morphTarget.settings;
+
+    MorphPoint point;
+    point.settings.thresholdDB = glide(from.thresholdDB, to.thresholdDB);
+    point.settings.width = glide(from.width, to.width);
+    point.settings.saturationDrive =
+        glide(from.saturationDrive, to.saturationDrive);
+    point.settings.makeupGainDB = glide(from.makeupGainDB, to.makeupGainDB);
+    point.wet = glide(morphStart.wet, morphTarget.wet);
+    return point;
+  }
+
+  // The staged chain with every stage in. Each stage ramps across the
+  // sub-block from where the last one left it to the settings at its end,
+  // which makes the glide piecewise linear, one segment per sub-block.
+  void processMorph(juce::dsp::AudioBlock<SampleType> &block) {
+    const auto wetStart = getMorphPoint(morphPosition).wet;
+    morphPosition += (int)block.getNumSamples();
+    const auto end = getMorphPoint(morphPosition);
+
+    saturator.rampDrive(end.settings.saturationDrive);
+    widener.rampWidth(end.settings.width);
+    limiter.setThreshold(end.settings.thresholdDB);
+    currentMakeupGain =
+        (SampleType)juce::Decibels::decibelsToGain(end.settings.makeupGainDB);
+
+    if (liveMode)
+      processChain<true, false, true, true>(block);
+    else
+      processChain<false, false, true, true>(block);
+
+    if (wetStart < 1.0f || end.wet < 1.0f)
+      crossfadeWithBypass(block, (SampleType)wetStart, (SampleType)end.wet);
+
+    if (morphPosition >= morphLength)
+      setParameters(currentSettings);
+  }
+
+  // Both paths have the same latency, so a linear crossfade keeps the level
+  void crossfadeWithBypass(juce::dsp::AudioBlock<SampleType> &block,
+                           SampleType wetStart, SampleType wetEnd) {
+    VCORE_REALTIME_STAGE("Bypass crossfade");
+    const auto numSamples = block.getNumSamples();
+    const auto channels = juce::jmin(block.getNumChannels(), numChannels);
+
+    fillLinearRamp(wetRamp, wetStart, wetEnd, numSamples);
+    fillLinearRamp(dryRamp, 1 - wetStart, 1 - wetEnd, numSamples);
+
+    for (size_t ch = 0; ch < channels; ++ch) {
+      auto *out = block.getChannelPointer(ch);
+      juce::FloatVectorOperations::multiply(out, wetRamp, (int)numSamples);
+      juce::FloatVectorOperations::addWithMultiply(
+          out, bypassDelay.getDelayed(ch, numSamples), dryRamp,
+          (int)numSamples);
+    }
   }
 
-private:
   double sampleRate = 44100.0;
-  juce::dsp::Oversampling<float> oversampling;
 
-  Saturator saturator;
-  StereoWidener widener;
-  W1Limiter limiter;
+  size_t oversamplingFactorLog2 = 2; // 4x
+  OversamplingFilter oversamplingFilter = OversamplingFilter::iir;
+  Oversampler<SampleType> oversampling;
+
+  bool liveMode = false;
+  SaturatorKernel saturatorKernel = SaturatorKernel::fast;
+
+  StateArena stateArena;
+  bool prepared = false;
+  size_t numChannels = 2;
+
+  // Channel pointer table for the fused live path
+  SampleType **channelScratch = nullptr;
+  int latencySamples = 0;
+  int tailSamples = 0;
+
+  bool autoSleep = true;
+  int silentSamples = 0;
+  size_t sleptSamples = 0;
+  bool asleep = false;
+
+  ModeSettings currentSettings;
+  bool fusedChain = true;
+  SubBlockFunction processFunction =
+      &VCoreEngine::processChain<false, true, false, false>;
+
+  BypassDelay<SampleType> bypassDelay;
+  bool chainIsStale = false;
+
+  Saturator<SampleType> saturator;
+  StereoWidener<SampleType> widener;
+  W1Limiter<SampleType> limiter;
+  SoftClipLimiter<SampleType> liveLimiter;
+
+  SampleType currentMakeupGain = 1;
+  SampleType rampStartMakeupGain = 1;
+
+  double morphSeconds = 0.05;
+  bool morphing = false;
+  MorphPoint morphStart, morphTarget;
+  int morphLength = 1;
+  int morphPosition = 0;
 
-  float currentMakeupGain = 1.0f;
+  // Per-sample makeup gain and crossfade weights while morphing
+  SampleType *gainRamp = nullptr;
+  SampleType *wetRamp = nullptr;
+  SampleType *dryRamp = nullptr;
 };
 } // namespace DSP
@@ -1,118 +1,259 @@
 #pragma once
+#include "MirroredRingBuffer.h"
+#include "SlidingWindowMax.h"
+#include "StateArena.h"
+#include "TruePeakDetector.h"
 #include <JuceHeader.h>
 #include <cmath>
+#include <memory>
 
 namespace DSP {
-class W1Limiter {
+// Lookahead true-peak limiter. All channels are linked: one gain, from the
+// loudest channel, is applied to every channel, so the image doesn't shift
+// between speakers when one of them gets limited.
+template <typename SampleType> class W1Limiter {
 public:
+  // Standalone use: state goes in the limiter's own arena
   void prepare(const juce::dsp::ProcessSpec &spec) {
+    configure(spec);
+    ownState.build([this](StateArena::Layout &l) { layoutState(l); });
+    reset();
+  }
+
+  // Sizes and coefficients only. Follow with layoutState() and reset().
+  void configure(const juce::dsp::ProcessSpec &spec) {
     sampleRate = spec.sampleRate;
+    maxBlockSize = (size_t)spec.maximumBlockSize;
+    numChannels = juce::jmax((size_t)1, (size_t)spec.numChannels);
     // 5ms lookahead
-    lookaheadSamples = (int)(0.005 * sampleRate);
-    ringBuffer.setSize(2, lookaheadSamples + 1024);
-    ringBuffer.clear();
-    writePos = 0;
+    lookaheadSamples = juce::jmax(1, (int)(0.005 * sampleRate));
+
+    // The audio is delayed by the lookahead plus the true-peak detector's
+    // own delay, so the detected peaks line up with the lookahead window.
+    delaySamples = lookaheadSamples + TruePeakDetector<SampleType>::latency;
+    // A whole block goes into the delay line before any of it is read back
+    delayLines =
+        std::make_unique<MirroredRingBuffer<SampleType>[]>(numChannels);
+    for (size_t ch = 0; ch < numChannels; ++ch)
+      delayLines[ch].allocate((size_t)delaySamples + spec.maximumBlockSize);
+
+    truePeak.prepare((int)spec.maximumBlockSize, (int)numChannels);
+
+    // Each detector value describes the stretch between two input samples,
+    // so the window is one sample wider than the lookahead span. The attack
+    // ramp is as long as the lookahead.
+    peakHold.prepare(lookaheadSamples + 2);
 
     // Release time: Adaptive usually, but let's set a safe 200ms base for
     // smooth vocal
     releaseCoef = std::exp(-1.0 / (0.2 * sampleRate));
+  }
 
-    currentGain = 1.0f;
+  // The lookahead delay lines are page-mapped (see MirroredRingBuffer); the
+  // detector, peak hold, attack ramp and scratch go in the arena, with the
+  // gain computer state in the hot section.
+  void layoutState(StateArena::Layout &layout) {
+    gainState = layout.hot<GainState>(1);
+    truePeak.layoutState(layout);
+    peakHold.layoutState(layout);
+    attackRamp = layout.cold<SampleType>((size_t)lookaheadSamples);
+    peakScratch = layout.cold<SampleType>(maxBlockSize);
+    inputWindows = layout.cold<SampleType *>(numChannels);
   }
 
+  // A no-op until layoutState() has placed the state
   void reset() {
-    ringBuffer.clear();
+    if (gainState == nullptr)
+      return;
+
+    for (size_t ch = 0; ch < numChannels; ++ch)
+      delayLines[ch].clear();
     writePos = 0;
-    currentGain = 1.0f;
+
+    truePeak.reset();
+    peakHold.reset();
+    std::fill(attackRamp, attackRamp + lookaheadSamples, SampleType(1));
+    *gainState = {(double)lookaheadSamples, SampleType(1), 0};
+  }
+
+  // Catches up on `numSamples` of silent input (at least the delay) that
+  // were never processed: the buffers would have flushed to zero, and the
+  // gain carries on releasing.
+  void skipSilence(size_t numSamples) {
+    if (gainState == nullptr)
+      return;
+
+    // The coefficient as processWrittenInput() rounds it, so the decay
+    // lands where running the release sample by sample would have
+    const auto release = (double)(SampleType)releaseCoef;
+    const auto decay = (SampleType)std::pow(release, (double)numSamples);
+    const auto gain =
+        SampleType(1) - (SampleType(1) - gainState->currentGain) * decay;
+    reset();
+
+    std::fill(attackRamp, attackRamp + lookaheadSamples, gain);
+    *gainState = {(double)lookaheadSamples * gain, gain, 0};
   }
 
-  void setThreshold(float dB) {
+  void setThreshold(SampleType dB) {
     // Unused for ceiling-based limiting, but if linked...
     // Logic handled in Engine usually.
   }
 
-  void setCeiling(float dB) { ceilingLin = juce::Decibels::decibelsToGain(dB); }
+  void setCeiling(SampleType dB) {
+    ceilingLin = juce::Decibels::decibelsToGain(dB);
+  }
+
+  int getLatencySamples() const { return delaySamples; }
 
-  void process(juce::dsp::AudioBlock<float> &block) {
-    auto numSamples = block.getNumSamples();
-    auto numChannels = block.getNumChannels();
+  size_t getDelayLineBytes() const {
+    size_t bytes = 0;
+    for (size_t ch = 0; ch < numChannels; ++ch)
+      bytes += delayLines[ch].getBytes();
+    return bytes;
+  }
 
-    int startWritePos = writePos; // Sync write pos for logic
+  void process(juce::dsp::AudioBlock<SampleType> &block) {
+    process(block, SampleType(1));
+  }
 
-    // Check max peak in the input block to drive envelop?
-    // Better: Sample by sample lookahead limiter
+  // Same, with `inputGain` applied to the input on its way into the
+  // lookahead line, so a gain stage in front costs no extra pass.
+  void process(juce::dsp::AudioBlock<SampleType> &block,
+               SampleType inputGain) {
+    const auto numSamples = block.getNumSamples();
+    const auto channels = juce::jmin(block.getNumChannels(), numChannels);
 
-    // To do proper lookahead limiting with shared gain reduction across
-    // channels:
-    // 1. Find max input peak at Lookahead point
-    // 2. Update Gain Reduction
-    // 3. Apply Gain Reduction to Delayed signal
+    for (size_t ch = 0; ch < channels; ++ch)
+      juce::FloatVectorOperations::multiply(getInputWindow(ch),
+                                            block.getChannelPointer(ch),
+                                            inputGain, (int)numSamples);
 
-    auto *channel0 = block.getChannelPointer(0);
-    auto *channel1 = (numChannels > 1) ? block.getChannelPointer(1) : nullptr;
+    processWrittenInput(block);
+  }
 
-    auto *rb0 = ringBuffer.getWritePointer(0);
-    auto *rb1 = ringBuffer.getWritePointer(1);
-    int rbSize = ringBuffer.getNumSamples();
+  // Where the next block of input goes, for a stage in front that can write
+  // its output straight into the lookahead line. Follow with
+  // processWrittenInput().
+  SampleType *getInputWindow(size_t channel) noexcept {
+    return delayLines[channel].window(writePos);
+  }
 
-    int localWritePos = startWritePos;
+  // getInputWindow() for every channel, as one table
+  SampleType *const *getInputWindows() noexcept {
+    for (size_t ch = 0; ch < numChannels; ++ch)
+      inputWindows[ch] = getInputWindow(ch);
+    return inputWindows;
+  }
+
+  // Limits the input already written into getInputWindow() for each of the
+  // block's channels, into `block`.
+  void processWrittenInput(juce::dsp::AudioBlock<SampleType> &block) {
+    const auto numSamples = block.getNumSamples();
+    const auto channels = juce::jmin(block.getNumChannels(), numChannels);
+
+    jassert(numSamples <= maxBlockSize);
+
+    // Gain computer, per sample:
+    // 1. Linked true peak of the newest ("future") samples
+    // 2. Max of that peak over the lookahead window (sliding window max)
+    // 3. Gain needed to keep that max under the ceiling, with slow release
+    // 4. Moving average of the gain over the lookahead length, so the gain
+    //    ramps down smoothly and has fully arrived when the peak comes out
+    //    of the delay line
+    // 5. Apply to the delayed ("now") signal
+
+    // The input is already in the lookahead line. Ring windows are
+    // contiguous, so the detector reads it straight from there.
+    const auto *inputs = getInputWindows();
+    for (size_t ch = 0; ch < channels; ++ch)
+      delayLines[ch].written(writePos, numSamples);
+
+    // 1. True peaks for the whole block, including inter-sample overs
+    auto *peaks = peakScratch;
+    truePeak.process(inputs, channels, peaks, numSamples);
+
+    const SampleType rampScale = SampleType(1) / (SampleType)lookaheadSamples;
+    const SampleType release = (SampleType)releaseCoef;
+
+    // Turns each peak into the gain for that sample, in place
+    auto *gains = peaks;
+
+    // Kept in locals for the loop: the gains are written through a pointer
+    // that could alias them
+    auto currentGain = gainState->currentGain;
+    auto attackRampSum = gainState->attackRampSum;
+    auto attackRampPos = gainState->attackRampPos;
 
     for (size_t i = 0; i < numSamples; ++i) {
-      float in0 = channel0[i];
-      float in1 = (channel1) ? channel1[i] : in0;
-
-      // 1. Write to Lookahead Buffer
-      rb0[(localWritePos + i) % rbSize] = in0;
-      rb1[(localWritePos + i) % rbSize] = in1;
-
-      // 2. Read from Lookahead (Delayed Signal) to be output implemented later?
-      // No, Limiter logic needs to know the peak *ahead* of time.
-      // The "Input" to the gain computer is the signal we just wrote (Future).
-      // The "Output" signal to apply gain to is the signal from the past (Now).
-
-      // Peak of the "Future" signal
-      float maxIn = std::max(std::abs(in0), std::abs(in1));
-
-      // Desired Gain to keep this Future signal under ceiling
-      float desiredGain = 1.0f;
-      if (maxIn > ceilingLin) {
-        desiredGain = ceilingLin / maxIn;
-      }
-
-      // Attack / Release Logic
-      // If we need to reduce gain (desired < current), attack is instant (or
-      // very fast) If we can increase gain (desired > current), release is slow
-
-      if (desiredGain < currentGain) {
-        currentGain = desiredGain; // Instant attack to catch peak
-      } else {
-        currentGain = desiredGain + releaseCoef * (currentGain - desiredGain);
-      }
-
-      // 3. Apply Current Gain to the "Past" (Output) signal
-      int readIndex = (localWritePos + i - lookaheadSamples + rbSize) % rbSize;
-
-      float delayed0 = rb0[readIndex];
-      float delayed1 = rb1[readIndex];
-
-      channel0[i] = delayed0 * currentGain;
-      if (channel1)
-        channel1[i] = delayed1 * currentGain;
+      // 2. Loudest peak anywhere between the output sample and the newest
+      const SampleType maxIn = peakHold.push(peaks[i]);
+
+      // 3. Gain that keeps it under the ceiling. Instant when it needs to go
+      // down (the ramp below smooths it), slow release when it can come up.
+      const SampleType heldGain =
+          maxIn > ceilingLin ? ceilingLin / maxIn : SampleType(1);
+
+      if (heldGain < currentGain)
+        currentGain = heldGain;
+      else
+        currentGain = heldGain + release * (currentGain - heldGain);
+
+      // 4. Running mean over the lookahead length
+      auto &oldest = attackRamp[attackRampPos];
+      attackRampSum += (double)currentGain - (double)oldest;
+      oldest = currentGain;
+      if (++attackRampPos == lookaheadSamples)
+        attackRampPos = 0;
+
+      gains[i] =
+          juce::jmin(SampleType(1), (SampleType)attackRampSum * rampScale);
     }
 
-    writePos = (writePos + (int)numSamples) % ringBuffer.getNumSamples();
+    *gainState = {attackRampSum, currentGain, attackRampPos};
+
+    // 5. Apply to the "Past" (Output) signal
+    const auto readPos = writePos - (size_t)delaySamples;
+    for (size_t ch = 0; ch < channels; ++ch)
+      juce::FloatVectorOperations::multiply(block.getChannelPointer(ch),
+                                            delayLines[ch].window(readPos),
+                                            gains, (int)numSamples);
+
+    writePos += numSamples;
   }
 
 private:
   double sampleRate = 44100.0;
-  int lookaheadSamples = 0;
+  int lookaheadSamples = 1;
+  int delaySamples = 1;
+
+  // Lookahead delay, one per channel. The ring buffers can't be moved, so
+  // no vector.
+  size_t numChannels = 1;
+  std::unique_ptr<MirroredRingBuffer<SampleType>[]> delayLines;
+  SampleType **inputWindows = nullptr;
+  size_t writePos = 0;
+
+  TruePeakDetector<SampleType> truePeak;
+  SlidingWindowMax<SampleType> peakHold;
+  SampleType *attackRamp = nullptr;
+
+  // Touched every sample, so it sits in the arena's hot section
+  struct GainState {
+    double attackRampSum = 0.0;
+    SampleType currentGain = 1;
+    int attackRampPos = 0;
+  };
+
+  GainState *gainState = nullptr;
+
+  size_t maxBlockSize = 0;
+  SampleType *peakScratch = nullptr;
 
-  juce::AudioBuffer<float> ringBuffer;
-  int writePos = 0;
+  StateArena ownState;
 
-  float ceilingLin = 0.891f; // -1.0dB
+  SampleType ceilingLin = (SampleType)0.891; // -1.0dB
 
-  float currentGain = 1.0f;
   double releaseCoef = 0.9995;
 };
 } // namespace DSP
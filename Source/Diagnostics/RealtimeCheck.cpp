@@ -0,0 +1,366 @@
+#include "RealtimeCheck.h"
+#include <JuceHeader.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+#include <dlfcn.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+#define VCORE_REALTIME_HOOK_POSIX 1
+#endif
+
+#if JUCE_LINUX
+#include <cstdarg>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#define VCORE_REALTIME_HOOK_FUTEX 1
+#endif
+
+#if JUCE_WINDOWS
+#include <malloc.h>
+#endif
+
+#if JUCE_LINUX && defined(__GLIBC__)
+#define VCORE_REALTIME_HOOK_LIBC 1
+#endif
+
+// Thread state must not allocate on first access from inside malloc, so force
+// the static TLS model where we can.
+#if defined(__GNUC__) || defined(__clang__)
+#define VCORE_REALTIME_TLS thread_local __attribute__((tls_model("initial-exec")))
+#else
+#define VCORE_REALTIME_TLS thread_local
+#endif
+
+namespace {
+// Name of the stage running on this thread, or nullptr when not armed.
+VCORE_REALTIME_TLS const char *currentStage = nullptr;
+
+[[noreturn]] void reportViolation(const char *call) {
+  const char *stage = currentStage;
+  currentStage = nullptr; // Let the report itself allocate and write
+
+  std::fprintf(stderr,
+               "\n*** V-CORE realtime violation: %s called in stage '%s' ***\n",
+               call, stage);
+  std::fputs(juce::SystemStats::getStackBacktrace().toRawUTF8(), stderr);
+  std::fflush(stderr);
+  std::abort();
+}
+
+inline void check(const char *call) {
+  if (currentStage != nullptr)
+    reportViolation(call);
+}
+} // namespace
+
+namespace Diagnostics {
+namespace RealtimeCheck {
+ScopedStage::ScopedStage(const char *stageName) noexcept
+    : previousStage(currentStage) {
+  currentStage = stageName;
+}
+
+ScopedStage::~ScopedStage() noexcept { currentStage = previousStage; }
+
+ScopedDisable::ScopedDisable() noexcept : previousStage(currentStage) {
+  currentStage = nullptr;
+}
+
+ScopedDisable::~ScopedDisable() noexcept { currentStage = previousStage; }
+} // namespace RealtimeCheck
+} // namespace Diagnostics
+
+//==============================================================================
+// operator new / delete
+
+void *operator new(std::size_t size) {
+  check("operator new");
+  if (auto *p = std::malloc(size == 0 ? 1 : size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  check("operator new");
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept {
+  return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept {
+  if (p != nullptr)
+    check("operator delete");
+  std::free(p);
+}
+
+void operator delete[](void *p) noexcept { operator delete(p); }
+void operator delete(void *p, std::size_t) noexcept { operator delete(p); }
+void operator delete[](void *p, std::size_t) noexcept { operator delete(p); }
+
+// Over-aligned types (alignas > 16) and explicitly aligned allocations, like
+// the DSP state arena, come through these instead
+namespace {
+void *allocateAligned(std::size_t size, std::align_val_t alignment) noexcept {
+  const auto align = std::max((std::size_t)alignment, sizeof(void *));
+#if JUCE_WINDOWS
+  return _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+  void *p = nullptr;
+  return posix_memalign(&p, align, size == 0 ? 1 : size) == 0 ? p : nullptr;
+#endif
+}
+
+void freeAligned(void *p) noexcept {
+#if JUCE_WINDOWS
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+} // namespace
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  check("operator new");
+  if (auto *p = allocateAligned(size, alignment))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+  return operator new(size, alignment);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment,
+                   const std::nothrow_t &) noexcept {
+  check("operator new");
+  return allocateAligned(size, alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment,
+                     const std::nothrow_t &tag) noexcept {
+  return operator new(size, alignment, tag);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+  if (p != nullptr)
+    check("operator delete");
+  freeAligned(p);
+}
+
+void operator delete[](void *p, std::align_val_t alignment) noexcept {
+  operator delete(p, alignment);
+}
+
+void operator delete(void *p, std::size_t,
+                     std::align_val_t alignment) noexcept {
+  operator delete(p, alignment);
+}
+
+void operator delete[](void *p, std::size_t,
+                       std::align_val_t alignment) noexcept {
+  operator delete(p, alignment);
+}
+
+void operator delete(void *p, std::align_val_t alignment,
+                     const std::nothrow_t &) noexcept {
+  operator delete(p, alignment);
+}
+
+void operator delete[](void *p, std::align_val_t alignment,
+                       const std::nothrow_t &) noexcept {
+  operator delete(p, alignment);
+}
+
+//==============================================================================
+// C allocator (glibc exposes the real implementation under __libc_*)
+
+#if VCORE_REALTIME_HOOK_LIBC
+extern "C" {
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+void *__libc_memalign(size_t, size_t);
+void __libc_free(void *);
+
+void *malloc(size_t size) {
+  check("malloc");
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  check("calloc");
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size) {
+  check("realloc");
+  return __libc_realloc(p, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  check("aligned_alloc");
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **result, size_t alignment, size_t size) {
+  check("posix_memalign");
+  *result = __libc_memalign(alignment, size);
+  return *result != nullptr ? 0 : ENOMEM;
+}
+
+void free(void *p) {
+  if (p != nullptr)
+    check("free");
+  __libc_free(p);
+}
+}
+#endif
+
+//==============================================================================
+// Locks and blocking syscalls
+
+#if VCORE_REALTIME_HOOK_POSIX
+namespace {
+template <typename Fn> Fn next(const char *name) {
+  return reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+}
+
+// Resolved at load time so the first lookup never happens on the audio thread
+struct RealFunctions {
+  decltype(&pthread_mutex_lock) mutexLock =
+      next<decltype(&pthread_mutex_lock)>("pthread_mutex_lock");
+  decltype(&pthread_cond_wait) condWait =
+      next<decltype(&pthread_cond_wait)>("pthread_cond_wait");
+  decltype(&pthread_cond_timedwait) condTimedWait =
+      next<decltype(&pthread_cond_timedwait)>("pthread_cond_timedwait");
+  decltype(&pthread_rwlock_rdlock) rwlockRead =
+      next<decltype(&pthread_rwlock_rdlock)>("pthread_rwlock_rdlock");
+  decltype(&pthread_rwlock_wrlock) rwlockWrite =
+      next<decltype(&pthread_rwlock_wrlock)>("pthread_rwlock_wrlock");
+  decltype(&sem_wait) semWait = next<decltype(&sem_wait)>("sem_wait");
+  decltype(&pthread_join) join = next<decltype(&pthread_join)>("pthread_join");
+  decltype(&nanosleep) nanoSleep = next<decltype(&nanosleep)>("nanosleep");
+  decltype(&usleep) uSleep = next<decltype(&usleep)>("usleep");
+  decltype(&read) readFn = next<decltype(&read)>("read");
+  decltype(&write) writeFn = next<decltype(&write)>("write");
+  decltype(&fsync) fsyncFn = next<decltype(&fsync)>("fsync");
+#if VCORE_REALTIME_HOOK_FUTEX
+  decltype(&sem_timedwait) semTimedWait =
+      next<decltype(&sem_timedwait)>("sem_timedwait");
+  long (*syscallFn)(long, ...) = next<long (*)(long, ...)>("syscall");
+#endif
+};
+
+const RealFunctions &real() {
+  static const RealFunctions functions;
+  return functions;
+}
+
+[[maybe_unused]] const RealFunctions &resolvedAtLoad = real();
+} // namespace
+
+extern "C" {
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+  check("pthread_mutex_lock");
+  return real().mutexLock(mutex);
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+  check("pthread_cond_wait");
+  return real().condWait(cond, mutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                           const struct timespec *deadline) {
+  check("pthread_cond_timedwait");
+  return real().condTimedWait(cond, mutex, deadline);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *lock) {
+  check("pthread_rwlock_rdlock");
+  return real().rwlockRead(lock);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *lock) {
+  check("pthread_rwlock_wrlock");
+  return real().rwlockWrite(lock);
+}
+
+int sem_wait(sem_t *semaphore) {
+  check("sem_wait");
+  return real().semWait(semaphore);
+}
+
+int pthread_join(pthread_t thread, void **result) {
+  check("pthread_join");
+  return real().join(thread, result);
+}
+
+int nanosleep(const struct timespec *duration, struct timespec *remaining) {
+  check("nanosleep");
+  return real().nanoSleep(duration, remaining);
+}
+
+int usleep(useconds_t microseconds) {
+  check("usleep");
+  return real().uSleep(microseconds);
+}
+
+ssize_t read(int fd, void *buffer, size_t count) {
+  check("read");
+  return real().readFn(fd, buffer, count);
+}
+
+ssize_t write(int fd, const void *buffer, size_t count) {
+  check("write");
+  return real().writeFn(fd, buffer, count);
+}
+
+int fsync(int fd) {
+  check("fsync");
+  return real().fsyncFn(fd);
+}
+
+#if VCORE_REALTIME_HOOK_FUTEX
+int sem_timedwait(sem_t *semaphore, const struct timespec *deadline) {
+  check("sem_timedwait");
+  return real().semTimedWait(semaphore, deadline);
+}
+
+// std::atomic::wait, std::counting_semaphore and friends block in
+// syscall(SYS_futex, ...) directly. Only the waiting operations are
+// flagged; waking a waiter doesn't block. The arguments are forwarded as
+// six longs whatever the call, the way libc's own wrapper reads them.
+long syscall(long number, ...) {
+  long args[6];
+  va_list list;
+  va_start(list, number);
+  for (auto &arg : args)
+    arg = va_arg(list, long);
+  va_end(list);
+
+  if (number == SYS_futex) {
+    const auto op = (int)args[1] & FUTEX_CMD_MASK;
+    if (op == FUTEX_WAIT || op == FUTEX_WAIT_BITSET || op == FUTEX_LOCK_PI ||
+        op == FUTEX_WAIT_REQUEUE_PI)
+      check("futex wait");
+  }
+
+  return real().syscallFn(number, args[0], args[1], args[2], args[3], args[4],
+                          args[5]);
+}
+#endif
+}
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+
+// Realtime-safety checker.
+//
+// When the project is configured with -DVCORE_REALTIME_CHECK=ON, every
+// allocation, mutex lock and blocking syscall made on a thread that is inside
+// a VCORE_REALTIME_STAGE scope aborts the process with the offending stage
+// name and a stack trace. In normal builds the macros compile to nothing.
+//
+// The hooks live in RealtimeCheck.cpp, which is only compiled into the
+// diagnostic build of the console executables: vcore_realtime_test,
+// vcore_bench, vcore_render and vcore_pipe. They work by defining malloc, operator new, pthread_mutex_lock
+// and so on in the executable itself, which takes precedence over the C and
+// C++ runtimes. Compiled into a plugin that a host dlopens they would not
+// replace the allocator the host process is already bound to, so the plugin
+// target never gets them.
+//
+// What is caught:
+//  - operator new/delete, aligned forms included, on every platform
+//  - malloc, calloc, realloc, aligned_alloc, posix_memalign and free on glibc
+//  - on POSIX: pthread_mutex_lock, pthread_cond_wait/timedwait,
+//    pthread_rwlock_rdlock/wrlock, sem_wait, pthread_join, nanosleep,
+//    usleep, read, write and fsync
+//  - on Linux: sem_timedwait and futex waits made through syscall(), which
+//    is where std::atomic::wait and std::counting_semaphore block
+//
+// What is not: try-lock and timed-lock variants other than the above, locks
+// taken inside the C library without going through these symbols, futex
+// calls made with inline syscall instructions, Mach and os_unfair_lock
+// primitives on macOS, and anything on Windows other than operator new.
+
+#if VCORE_REALTIME_CHECK
+
+namespace Diagnostics {
+namespace RealtimeCheck {
+// Arms the checker for the calling thread and names the stage that is
+// currently running. Scopes nest; the innermost name is the one reported.
+class ScopedStage {
+public:
+  explicit ScopedStage(const char *stageName) noexcept;
+  ~ScopedStage() noexcept;
+
+  ScopedStage(const ScopedStage &) = delete;
+  ScopedStage &operator=(const ScopedStage &) = delete;
+
+private:
+  const char *previousStage;
+};
+
+// Temporarily disarms the checker, e.g. for a call that is known to be safe
+// but goes through a hooked function.
+class ScopedDisable {
+public:
+  ScopedDisable() noexcept;
+  ~ScopedDisable() noexcept;
+
+  ScopedDisable(const ScopedDisable &) = delete;
+  ScopedDisable &operator=(const ScopedDisable &) = delete;
+
+private:
+  const char *previousStage;
+};
+} // namespace RealtimeCheck
+} // namespace Diagnostics
+
+#define VCORE_REALTIME_JOIN_(a, b) a##b
+#define VCORE_REALTIME_JOIN(a, b) VCORE_REALTIME_JOIN_(a, b)
+#define VCORE_REALTIME_STAGE(name)                                             \
+  ::Diagnostics::RealtimeCheck::ScopedStage VCORE_REALTIME_JOIN(               \
+      vcoreRealtimeStage_, __LINE__)(name)
+
+#else
+
+#define VCORE_REALTIME_STAGE(name) ((void)0)
+
+#endif
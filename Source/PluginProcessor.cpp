@@ -1,4 +1,5 @@
 #include "PluginProcessor.h"
+#include "DSP/SpeakerPairs.h"
 #include "PluginEditor.h"
 
 EAVCOREAudioProcessor::EAVCOREAudioProcessor()
@@ -15,9 +16,25 @@ EAVCOREAudioProcessor::EAVCOREAudioProcessor()
       apvts(*this, nullptr, "Parameters", createParameterLayout())
 #endif
 {
+  modeParam = apvts.getRawParameterValue("main_knob");
+  morphTimeParam = apvts.getRawParameterValue("morph_time");
+
+  for (int mode = 0; mode < DSP::numModes; ++mode)
+    modeSettings[(size_t)mode] = DSP::getModeSettings(mode);
+
+  // Mode and morph time aren't listened to: the audio thread reads them
+  // itself every block
+  apvts.addParameterListener("oversampling", this);
+  apvts.addParameterListener("os_filter", this);
+  apvts.addParameterListener("live_mode", this);
 }
 
-EAVCOREAudioProcessor::~EAVCOREAudioProcessor() {}
+EAVCOREAudioProcessor::~EAVCOREAudioProcessor() {
+  apvts.removeParameterListener("oversampling", this);
+  apvts.removeParameterListener("os_filter", this);
+  apvts.removeParameterListener("live_mode", this);
+  cancelPendingUpdate();
+}
 
 const juce::String EAVCOREAudioProcessor::getName() const {
   return "EA V-CORE";
@@ -47,7 +64,15 @@ bool EAVCOREAudioProcessor::isMidiEffect() const {
 #endif
 }
 
-double EAVCOREAudioProcessor::getTailLengthSeconds() const { return 0.0; }
+double EAVCOREAudioProcessor::getTailLengthSeconds() const {
+  if (!isPrepared || currentSpec.sampleRate <= 0.0)
+    return 0.0;
+
+  const auto tailSamples = isUsingDoublePrecision()
+                               ? doubleEngine.getTailSamples()
+                               : floatEngine.getTailSamples();
+  return tailSamples / currentSpec.sampleRate;
+}
 
 int EAVCOREAudioProcessor::getNumPrograms() {
   return 1; // NB: some hosts don't cope very well if you tell them there are 0
@@ -73,10 +98,91 @@ void EAVCOREAudioProcessor::prepareToPlay(double sampleRate,
   spec.maximumBlockSize = samplesPerBlock;
   spec.numChannels = getTotalNumOutputChannels();
 
-  vCoreEngine.prepare(spec);
+  currentSpec = spec;
+  isPrepared = true;
+
+  updateEngineConfig(true);
 }
 
-void EAVCOREAudioProcessor::releaseResources() { vCoreEngine.reset(); }
+void EAVCOREAudioProcessor::updateEngineConfig(bool forcePrepare) {
+  EngineConfig config;
+
+  if (isNonRealtime()) {
+    // Offline renders always get the best quality: 8x, linear phase
+    config.oversamplingFactorLog2 =
+        DSP::VCoreEngine<float>::maxOversamplingFactorLog2;
+    config.oversamplingFilter = DSP::OversamplingFilter::linearPhase;
+  } else {
+    config.oversamplingFactorLog2 = (size_t)juce::jlimit(
+        0, (int)DSP::VCoreEngine<float>::maxOversamplingFactorLog2,
+        (int)apvts.getRawParameterValue("oversampling")->load());
+    config.oversamplingFilter =
+        apvts.getRawParameterValue("os_filter")->load() > 0.5f
+            ? DSP::OversamplingFilter::linearPhase
+            : DSP::OversamplingFilter::iir;
+    config.liveMode = apvts.getRawParameterValue("live_mode")->load() > 0.5f;
+  }
+
+  if (!isPrepared || (config == engineConfig && !forcePrepare))
+    return;
+
+  // Switching between realtime and offline quality only ever happens in
+  // prepareToPlay. Rebuilding from the message thread could land partway
+  // through a bounce and change the sound and the latency mid-file.
+  if (!forcePrepare && isNonRealtime())
+    return;
+
+  // From prepareToPlay the host isn't processing; from the message thread
+  // we have to hold the audio callback off while the engine is rebuilt.
+  const auto needsSuspend = !forcePrepare;
+
+  if (needsSuspend)
+    suspendProcessing(true);
+
+  engineConfig = config;
+
+  auto prepareEngine = [&](auto &engine) {
+    engine.setOversampling(config.oversamplingFactorLog2,
+                           config.oversamplingFilter);
+    engine.setLiveMode(config.liveMode);
+    engine.setWidenerPairs(
+        DSP::getWidenerPairs(getChannelLayoutOfBus(false, 0)));
+    engine.prepare(currentSpec);
+
+    // Nothing is playing yet, so start on the current mode rather than
+    // gliding to it
+    engineMode = getCurrentMode();
+    engine.setParameters(modeSettings[(size_t)engineMode]);
+    setLatencySamples(engine.getLatencySamples());
+  };
+
+  if (isUsingDoublePrecision())
+    prepareEngine(doubleEngine);
+  else
+    prepareEngine(floatEngine);
+
+  if (needsSuspend)
+    suspendProcessing(false);
+}
+
+void EAVCOREAudioProcessor::parameterChanged(const juce::String &parameterID,
+                                             float newValue) {
+  juce::ignoreUnused(parameterID, newValue);
+
+  // May be called on the audio thread; rebuild later on the message thread
+  triggerAsyncUpdate();
+}
+
+void EAVCOREAudioProcessor::handleAsyncUpdate() { updateEngineConfig(false); }
+
+int EAVCOREAudioProcessor::getCurrentMode() const {
+  return juce::jlimit(0, DSP::numModes - 1, (int)std::round(modeParam->load()));
+}
+
+void EAVCOREAudioProcessor::releaseResources() {
+  floatEngine.reset();
+  doubleEngine.reset();
+}
 
 #ifndef JucePlugin_PreferredChannelConfigurations
 bool EAVCOREAudioProcessor::isBusesLayoutSupported(
@@ -85,8 +191,9 @@ bool EAVCOREAudioProcessor::isBusesLayoutSupported(
   juce::ignoreUnused(layouts);
   return true;
 #else
-  if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono() &&
-      layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+  // Any layout: the limiters and saturator cover every channel, and the
+  // widener finds the speaker pairs in it
+  if (layouts.getMainOutputChannelSet().isDisabled())
     return false;
 
 #if !JucePlugin_IsSynth
@@ -100,7 +207,32 @@ bool EAVCOREAudioProcessor::isBusesLayoutSupported(
 #endif
 
 void EAVCOREAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
-                                         juce::MidiBuffer &midiMessages) {
+                                         juce::MidiBuffer &) {
+  VCORE_REALTIME_STAGE("processBlock");
+  processWithEngine(buffer, false);
+}
+
+void EAVCOREAudioProcessor::processBlock(juce::AudioBuffer<double> &buffer,
+                                         juce::MidiBuffer &) {
+  VCORE_REALTIME_STAGE("processBlock");
+  processWithEngine(buffer, false);
+}
+
+void EAVCOREAudioProcessor::processBlockBypassed(
+    juce::AudioBuffer<float> &buffer, juce::MidiBuffer &) {
+  VCORE_REALTIME_STAGE("processBlockBypassed");
+  processWithEngine(buffer, true);
+}
+
+void EAVCOREAudioProcessor::processBlockBypassed(
+    juce::AudioBuffer<double> &buffer, juce::MidiBuffer &) {
+  VCORE_REALTIME_STAGE("processBlockBypassed");
+  processWithEngine(buffer, true);
+}
+
+template <typename SampleType>
+void EAVCOREAudioProcessor::processWithEngine(
+    juce::AudioBuffer<SampleType> &buffer, bool bypassed) {
   juce::ScopedNoDenormals noDenormals;
   auto totalNumInputChannels = getTotalNumInputChannels();
   auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -108,17 +240,26 @@ void EAVCOREAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
   for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
     buffer.clear(i, 0, buffer.getNumSamples());
 
-  // Update Parameters from APVTS
-  // This is thread-safe for reading raw values
-  auto *knobParam = apvts.getRawParameterValue("main_knob");
-  if (knobParam != nullptr) {
-    // Round to nearest integer for step
-    int mode = std::round(knobParam->load());
-    vCoreEngine.setParameters(mode);
+  auto &engine = getEngine<SampleType>();
+
+  if (bypassed) {
+    // The dry signal, delayed by the latency we report, so bypassing in the
+    // host doesn't shift the track in time
+    engine.processBypassed(buffer);
+    return;
+  }
+
+  // Glide to the mode on the knob. The parameters are read here, at the
+  // block the host automates them in, rather than handed over from the
+  // message thread, so an offline bounce comes out the same every time.
+  if (const auto mode = getCurrentMode(); mode != engineMode) {
+    engineMode = mode;
+    engine.setMorphTime(morphTimeParam->load() * 0.001);
+    engine.morphTo(modeSettings[(size_t)mode]);
   }
 
   // Process Audio
-  vCoreEngine.process(buffer);
+  engine.process(buffer);
 }
 
 bool EAVCOREAudioProcessor::hasEditor() const { return true; }
@@ -156,6 +297,25 @@ EAVCOREAudioProcessor::createParameterLayout() {
                                                 0            // default value
                                                 ));
 
+  // How long a mode change takes to glide from one mode to the next
+  layout.add(std::make_unique<juce::AudioParameterFloat>(
+      "morph_time", "Morph Time",
+      juce::NormalisableRange<float>(0.0f, 500.0f, 1.0f), 50.0f,
+      juce::AudioParameterFloatAttributes().withLabel("ms")));
+
+  // Realtime quality. Offline renders always use 8x linear phase.
+  layout.add(std::make_unique<juce::AudioParameterChoice>(
+      "oversampling", "Oversampling",
+      juce::StringArray{"1x", "2x", "4x", "8x"}, 2));
+
+  layout.add(std::make_unique<juce::AudioParameterChoice>(
+      "os_filter", "Oversampling Filter",
+      juce::StringArray{"IIR (Low Latency)", "Linear Phase"}, 0));
+
+  // One-sample-latency monitoring path; overrides the oversampling settings
+  layout.add(std::make_unique<juce::AudioParameterBool>("live_mode",
+                                                        "Live Mode", false));
+
   return layout;
 }
 
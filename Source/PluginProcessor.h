@@ -3,7 +3,10 @@
 #include "DSP/VCoreEngine.h"
 #include <JuceHeader.h>
 
-class EAVCOREAudioProcessor : public juce::AudioProcessor {
+class EAVCOREAudioProcessor
+    : public juce::AudioProcessor,
+      private juce::AudioProcessorValueTreeState::Listener,
+      private juce::AsyncUpdater {
 public:
   EAVCOREAudioProcessor();
   ~EAVCOREAudioProcessor() override;
@@ -16,6 +19,13 @@ public:
 #endif
 
   void processBlock(juce::AudioBuffer<float> &, juce::MidiBuffer &) override;
+  void processBlock(juce::AudioBuffer<double> &, juce::MidiBuffer &) override;
+  void processBlockBypassed(juce::AudioBuffer<float> &,
+                            juce::MidiBuffer &) override;
+  void processBlockBypassed(juce::AudioBuffer<double> &,
+                            juce::MidiBuffer &) override;
+
+  bool supportsDoublePrecisionProcessing() const override { return true; }
 
   juce::AudioProcessorEditor *createEditor() override;
   bool hasEditor() const override;
@@ -41,7 +51,57 @@ public:
 private:
   juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
-  DSP::VCoreEngine vCoreEngine;
+  void parameterChanged(const juce::String &parameterID,
+                        float newValue) override;
+  void handleAsyncUpdate() override;
+
+  // Settings that need the engine to be re-prepared when they change
+  struct EngineConfig {
+    size_t oversamplingFactorLog2 = 2;
+    DSP::OversamplingFilter oversamplingFilter = DSP::OversamplingFilter::iir;
+    bool liveMode = false;
+
+    bool operator==(const EngineConfig &) const = default;
+  };
+
+  // Picks the engine configuration for the current render mode and, if it
+  // differs from what the engine runs, re-prepares the engine and reports
+  // the new latency. Message thread / prepareToPlay only; from the message
+  // thread it does nothing during an offline render, which keeps the
+  // configuration prepareToPlay gave it.
+  void updateEngineConfig(bool forcePrepare);
+
+  int getCurrentMode() const;
+
+  template <typename SampleType>
+  void processWithEngine(juce::AudioBuffer<SampleType> &buffer, bool bypassed);
+
+  // Only the engine for the host's processing precision is prepared; the
+  // host calls prepareToPlay again whenever it changes the precision.
+  template <typename SampleType> DSP::VCoreEngine<SampleType> &getEngine() {
+    if constexpr (std::is_same_v<SampleType, double>)
+      return doubleEngine;
+    else
+      return floatEngine;
+  }
+
+  DSP::VCoreEngine<float> floatEngine;
+  DSP::VCoreEngine<double> doubleEngine;
+  EngineConfig engineConfig;
+
+  juce::dsp::ProcessSpec currentSpec{};
+  bool isPrepared = false;
+
+  std::atomic<float> *modeParam = nullptr;
+  std::atomic<float> *morphTimeParam = nullptr;
+
+  // The settings for every mode, built once in the constructor so the audio
+  // thread only ever picks one
+  std::array<DSP::ModeSettings, DSP::numModes> modeSettings;
+
+  // The mode the engine is on or gliding to. Audio thread, or while it is
+  // held off for a prepare.
+  int engineMode = 0;
 
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(EAVCOREAudioProcessor)
 };
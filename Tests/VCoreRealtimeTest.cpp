@@ -0,0 +1,374 @@
+// vcore_realtime_test: drives the engine and the plugin's processBlock
+// through every configuration with the realtime-safety checker armed around
+// everything the audio thread calls.
+//
+// First it checks the checker: in a child process per call, an allocation,
+// lock, semaphore, futex wait, sleep or write inside a VCORE_REALTIME_STAGE
+// must abort. If one doesn't, the hooks aren't in place (link order, LTO, a
+// C library change) and every other case would pass without checking
+// anything, so the test fails. `--self-test` runs only this part.
+//
+// Each engine case prepares an engine (allowed to allocate), then, inside a
+// VCORE_REALTIME_STAGE scope like the plugin's processBlock, processes
+// signal, silence long enough to put it to sleep, signal again to wake it,
+// host bypass and a morph into and out of every other mode, in blocks of an
+// odd size. Covers every mode, oversampling factor and filter, live mode,
+// mono to 5.1 and both precisions.
+//
+// Each plugin case does the same through EAVCOREAudioProcessor, whose
+// processBlock arms the checker itself: the host changes the mode and morph
+// time between blocks, and the audio thread picks them up, glides, sleeps
+// and bypasses. Covers the realtime settings, offline rendering, mono to 5.1
+// and both precisions.
+//
+// Any allocation, lock or blocking call aborts the process (and fails the
+// ctest run) with the stage name and a stack trace. Needs
+// -DVCORE_REALTIME_CHECK=ON, which is the only build that has this target.
+
+#include "DSP/SpeakerPairs.h"
+#include "DSP/VCoreEngine.h"
+#include "PluginProcessor.h"
+#include <JuceHeader.h>
+
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define VCORE_REALTIME_SELF_TEST 1
+#endif
+
+#if JUCE_LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#if !VCORE_REALTIME_CHECK
+#error "vcore_realtime_test needs the realtime checker (VCORE_REALTIME_CHECK)"
+#endif
+
+namespace {
+constexpr double sampleRate = 48000.0;
+constexpr int maxBlockSize = 1024;
+
+// Odd sizes on purpose: partial sub-blocks, one sample, and more than the
+// prepared maximum
+const int blockSizes[] = {1, 7, 63, 65, 333, 1021, 2053};
+const int channelCounts[] = {1, 2, 6};
+
+//==============================================================================
+#if VCORE_REALTIME_SELF_TEST
+// Runs the call armed in a child process, which the checker should abort.
+// The child's report goes to /dev/null; an alarm stops a call the checker
+// missed from hanging the test.
+template <typename Call> bool checkerAborts(const char *name, Call &&call) {
+  const auto pid = fork();
+
+  if (pid == 0) {
+    if (const auto devNull = open("/dev/null", O_WRONLY); devNull >= 0)
+      dup2(devNull, STDERR_FILENO);
+
+    alarm(10);
+    {
+      VCORE_REALTIME_STAGE("checker self-test");
+      call();
+    }
+    _exit(0);
+  }
+
+  int status = 0;
+  const auto aborted = pid > 0 && waitpid(pid, &status, 0) == pid &&
+                       WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+
+  if (!aborted)
+    std::cerr << "vcore_realtime_test: the checker missed " << name
+              << std::endl;
+
+  return aborted;
+}
+
+// Everything is set up outside the stage, so only the call itself is
+// checked, and nothing blocks if the checker lets it through
+bool runSelfTest() {
+  bool ok = true;
+
+  ok &= checkerAborts("operator new", [] {
+    int *volatile p = new int(1);
+    delete p;
+  });
+
+  ok &= checkerAborts("malloc", [] {
+    void *volatile p = std::malloc(64);
+    std::free(p);
+  });
+
+  std::mutex mutex;
+  ok &= checkerAborts("a mutex lock", [&] {
+    mutex.lock();
+    mutex.unlock();
+  });
+
+  pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+  ok &= checkerAborts("a read lock", [&] {
+    pthread_rwlock_rdlock(&rwlock);
+    pthread_rwlock_unlock(&rwlock);
+  });
+
+  sem_t semaphore;
+  sem_init(&semaphore, 0, 1);
+  ok &= checkerAborts("sem_wait", [&] { sem_wait(&semaphore); });
+
+  ok &= checkerAborts("a sleep", [] {
+    std::this_thread::sleep_for(std::chrono::microseconds(1));
+  });
+
+  ok &= checkerAborts("usleep", [] { usleep(1); });
+
+  ok &= checkerAborts("write", [] { (void)write(STDERR_FILENO, "", 0); });
+
+#if JUCE_LINUX
+  // Expects a value the word doesn't hold, so returns at once if missed
+  int word = 0;
+  ok &= checkerAborts("a futex wait", [&] {
+    syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, 1, nullptr, nullptr, 0);
+  });
+#endif
+
+  sem_destroy(&semaphore);
+  pthread_rwlock_destroy(&rwlock);
+  return ok;
+}
+#else
+bool runSelfTest() {
+  std::cerr << "vcore_realtime_test: no checker self-test on this platform"
+            << std::endl;
+  return true;
+}
+#endif
+
+//==============================================================================
+template <typename SampleType>
+void fillTone(juce::AudioBuffer<SampleType> &buffer, int start) {
+  for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+    for (int i = 0; i < buffer.getNumSamples(); ++i)
+      buffer.setSample(ch, i,
+                       (SampleType)(0.8 * std::sin(0.031 * (start + i) +
+                                                   0.7 * ch)));
+}
+
+// Everything the plugin's audio thread can do to the engine
+template <typename SampleType>
+void runAudioThread(DSP::VCoreEngine<SampleType> &engine,
+                    juce::AudioBuffer<SampleType> &buffer, int mode) {
+  VCORE_REALTIME_STAGE("VCoreEngine (test)");
+
+  const auto blockSize = buffer.getNumSamples();
+  auto processFor = [&](int numSamples, bool silent, bool bypassed) {
+    for (int done = 0; done < numSamples; done += blockSize) {
+      if (silent)
+        buffer.clear();
+      else
+        fillTone(buffer, done);
+
+      if (bypassed)
+        engine.processBypassed(buffer);
+      else
+        engine.process(buffer);
+    }
+  };
+
+  const auto tail = engine.getTailSamples() + 2 * maxBlockSize;
+
+  processFor(4096, false, false);
+  processFor(tail, true, false); // Falls asleep
+  processFor(4096, false, false); // Wakes up
+  processFor(1024, false, true);
+
+  engine.setMorphTime(0.01);
+  for (int other = 0; other < DSP::numModes; ++other) {
+    engine.morphTo(DSP::getModeSettings(other));
+    processFor(1024, false, false);
+    engine.morphTo(DSP::getModeSettings(mode));
+    processFor(1024, false, false);
+  }
+
+  engine.setParameters(mode);
+  processFor(1024, false, false);
+}
+
+template <typename SampleType> int runEngine() {
+  using Engine = DSP::VCoreEngine<SampleType>;
+
+  struct Config {
+    bool live;
+    size_t factorLog2;
+    DSP::OversamplingFilter filter;
+  };
+
+  std::vector<Config> configs;
+  configs.push_back({true, 0, DSP::OversamplingFilter::iir});
+  for (size_t factorLog2 = 0; factorLog2 <= Engine::maxOversamplingFactorLog2;
+       ++factorLog2)
+    for (auto filter : {DSP::OversamplingFilter::iir,
+                        DSP::OversamplingFilter::linearPhase})
+      configs.push_back({false, factorLog2, filter});
+
+  int numCases = 0;
+
+  for (const auto &config : configs) {
+    for (auto channels : channelCounts) {
+      for (auto blockSize : blockSizes) {
+        for (int mode = 0; mode < Engine::numModes; ++mode) {
+          Engine engine;
+          engine.setOversampling(config.factorLog2, config.filter);
+          engine.setLiveMode(config.live);
+          engine.setWidenerPairs(DSP::getWidenerPairs(
+              juce::AudioChannelSet::canonicalChannelSet(channels)));
+          engine.prepare({sampleRate, (juce::uint32)maxBlockSize,
+                          (juce::uint32)channels});
+          engine.setParameters(mode);
+
+          juce::AudioBuffer<SampleType> buffer(channels, blockSize);
+          runAudioThread(engine, buffer, mode);
+          ++numCases;
+        }
+      }
+    }
+  }
+
+  return numCases;
+}
+
+//==============================================================================
+// As a host would: parameters are set from outside the audio callback, and
+// only processBlock runs armed
+void setParameter(EAVCOREAudioProcessor &processor, const char *id,
+                  float value) {
+  auto *parameter = processor.apvts.getParameter(id);
+  parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+}
+
+template <typename SampleType>
+void runPluginCallbacks(EAVCOREAudioProcessor &processor,
+                        juce::AudioBuffer<SampleType> &buffer) {
+  juce::MidiBuffer midi;
+  const auto blockSize = buffer.getNumSamples();
+
+  auto processFor = [&](int numSamples, bool silent, bool bypassed) {
+    for (int done = 0; done < numSamples; done += blockSize) {
+      if (silent)
+        buffer.clear();
+      else
+        fillTone(buffer, done);
+
+      if (bypassed)
+        processor.processBlockBypassed(buffer, midi);
+      else
+        processor.processBlock(buffer, midi);
+    }
+  };
+
+  const auto tail =
+      (int)(processor.getTailLengthSeconds() * sampleRate) + 2 * maxBlockSize;
+
+  processFor(4096, false, false);
+  processFor(tail, true, false); // Falls asleep
+  processFor(4096, false, false); // Wakes up
+  processFor(1024, false, true);
+
+  // Every mode change, with and without a glide, and one in the middle of
+  // another
+  for (auto morphTimeMs : {0.0f, 10.0f}) {
+    setParameter(processor, "morph_time", morphTimeMs);
+
+    for (int mode = 0; mode < DSP::numModes; ++mode) {
+      for (int other = 0; other < DSP::numModes; ++other) {
+        setParameter(processor, "main_knob", (float)other);
+        processFor(256, false, false);
+        setParameter(processor, "main_knob", (float)mode);
+        processFor(1024, false, false);
+      }
+    }
+  }
+}
+
+template <typename SampleType> int runPlugin() {
+  struct Config {
+    bool offline;
+    bool live;
+    int oversampling;
+    bool linearPhase;
+  };
+
+  std::vector<Config> configs;
+  configs.push_back({true, false, 0, false});
+  configs.push_back({false, true, 0, false});
+  for (int oversampling = 0; oversampling < 4; ++oversampling)
+    for (auto linearPhase : {false, true})
+      configs.push_back({false, false, oversampling, linearPhase});
+
+  int numCases = 0;
+
+  for (const auto &config : configs) {
+    for (auto channels : channelCounts) {
+      for (auto blockSize : {1, 63, 333, 2053}) {
+        EAVCOREAudioProcessor processor;
+
+        const auto channelSet =
+            juce::AudioChannelSet::canonicalChannelSet(channels);
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add(channelSet);
+        layout.outputBuses.add(channelSet);
+        processor.setBusesLayout(layout);
+
+        processor.setProcessingPrecision(
+            std::is_same_v<SampleType, double>
+                ? juce::AudioProcessor::doublePrecision
+                : juce::AudioProcessor::singlePrecision);
+        processor.setNonRealtime(config.offline);
+        setParameter(processor, "oversampling", (float)config.oversampling);
+        setParameter(processor, "os_filter", config.linearPhase ? 1.0f : 0.0f);
+        setParameter(processor, "live_mode", config.live ? 1.0f : 0.0f);
+        processor.prepareToPlay(sampleRate, maxBlockSize);
+
+        juce::AudioBuffer<SampleType> buffer(channels, blockSize);
+        runPluginCallbacks(processor, buffer);
+        processor.releaseResources();
+        ++numCases;
+      }
+    }
+  }
+
+  return numCases;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  // Before JUCE starts any threads, so the children are plain forks
+  if (!runSelfTest())
+    return 1;
+
+  if (argc > 1 && juce::String(argv[1]) == "--self-test") {
+    std::cout << "vcore_realtime_test: the checker catches every call tried"
+              << std::endl;
+    return 0;
+  }
+
+  const juce::ScopedJuceInitialiser_GUI scopedJuce;
+  juce::ScopedNoDenormals noDenormals;
+
+  const auto numEngineCases = runEngine<float>() + runEngine<double>();
+  const auto numPluginCases = runPlugin<float>() + runPlugin<double>();
+
+  std::cout << "vcore_realtime_test: " << numEngineCases << " engine and "
+            << numPluginCases << " plugin cases, no realtime violations"
+            << std::endl;
+  return 0;
+}
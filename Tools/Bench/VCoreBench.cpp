@@ -0,0 +1,1093 @@
+// vcore_bench: micro-benchmarks for every DSP stage and the full engine.
+//
+// Sweeps all modes, sample rates and host block sizes, in both float and
+// double precision, and prints one JSON document to stdout. Each stage is fed
+// the same block length and rate the engine would feed it (one internal
+// sub-block, oversampled where the engine oversamples), so per-stage costs
+// add up to the engine cost.
+//
+// --aliasing runs the saturator aliasing study instead: every tanh kernel at
+// every oversampling factor, reporting alias level and CPU cost for each.
+// It also measures the upsamplers' image rejection across the passband, for
+// both filters at every factor.
+//
+// --images runs only the image rejection measurement, and exits with a
+// non-zero status if any filter and factor does worse than its quoted worst
+// case.
+//
+// --latency checks the latency the engine reports against the measured
+// delay of an impulse, for every oversampling setting and both precisions.
+// Exits with a non-zero status if any of them disagree.
+//
+// --verify checks the fused engine against the staged reference over every
+// mode, oversampling setting, live mode, channel layout and a range of host
+// block sizes, and an engine that sleeps through silence against one that
+// never does. Exits with a non-zero status on any mismatch. --quick trims
+// the block sizes.
+//
+// The engine entries carry a model of the memory traffic of the host-rate
+// stages (widener, makeup gain, limiter input and output), in bytes per
+// sample per channel, so the fused and staged timings can be read against
+// how much each path touches.
+//
+//   vcore_bench [--seconds <audio seconds per case>] [--stage <name>]
+//               [--precision float|double] [--quick] [--aliasing]
+//               [--latency] [--verify] [--images]
+
+#include "DSP/VCoreEngine.h"
+#include <JuceHeader.h>
+
+#include <chrono>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include <iostream>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr int numChannels = 2;
+
+// 7.1.4 in JUCE's channel order: L R C LFE Ls Rs Lrs Rrs Ltf Rtf Ltr Rtr.
+// The widener gets the five left/right pairs.
+constexpr int immersiveChannels = 12;
+const std::vector<DSP::ChannelPair> immersivePairs = {
+    {0, 1}, {4, 5}, {6, 7}, {8, 9}, {10, 11}};
+const double sampleRates[] = {44100.0, 48000.0, 88200.0,
+                              96000.0, 176400.0, 192000.0};
+const int blockSizes[] = {16, 32, 64, 128, 256, 512, 1024, 2048, 4096};
+
+struct Options {
+  double secondsPerCase = 2.0;
+  juce::String stageFilter;
+  juce::String precisionFilter;
+  bool quick = false;
+  bool aliasing = false;
+  bool latency = false;
+  bool verify = false;
+  bool images = false;
+};
+
+struct Result {
+  double nsPerSample = 0.0;
+  double realtimeFactor = 0.0;
+};
+
+// Deterministic pink-ish noise around -12 dBFS so the limiter and saturator
+// do real work. The same values in either precision.
+template <typename SampleType>
+void fillTestSignal(juce::AudioBuffer<SampleType> &buffer) {
+  juce::Random random(0x5ca1ab1e);
+
+  for (int ch = 0; ch < buffer.getNumChannels(); ++ch) {
+    auto *data = buffer.getWritePointer(ch);
+    float state = 0.0f;
+
+    for (int i = 0; i < buffer.getNumSamples(); ++i) {
+      state = 0.9f * state + 0.1f * (random.nextFloat() * 2.0f - 1.0f);
+      data[i] = 0.25f * (random.nextFloat() * 2.0f - 1.0f) + 2.0f * state;
+    }
+  }
+}
+
+template <typename SampleType> constexpr const char *precisionName() {
+  return std::is_same_v<SampleType, double> ? "double" : "float";
+}
+
+// Runs `process` over `seconds` worth of audio at `sampleRate` in blocks of
+// `blockSize` and times only the processing calls.
+template <typename SampleType, typename Process>
+Result timeCase(const juce::AudioBuffer<SampleType> &source, int blockSize,
+                double sampleRate, double seconds, const Process &process,
+                juce::AudioBuffer<SampleType> &work) {
+  const auto totalSamples = juce::jmax((juce::int64)blockSize * 8,
+                                       (juce::int64)(seconds * sampleRate));
+  const auto numBlocks = (int)(totalSamples / blockSize);
+  const auto sourceLength = source.getNumSamples();
+
+  const auto channels = work.getNumChannels();
+
+  // Warm up caches and let the limiter settle
+  for (int b = 0; b < 8; ++b) {
+    for (int ch = 0; ch < channels; ++ch)
+      work.copyFrom(ch, 0, source, ch, 0, blockSize);
+    process(work);
+  }
+
+  Clock::duration elapsed{};
+  int readPos = 0;
+
+  for (int b = 0; b < numBlocks; ++b) {
+    if (readPos + blockSize > sourceLength)
+      readPos = 0;
+
+    for (int ch = 0; ch < channels; ++ch)
+      work.copyFrom(ch, 0, source, ch, readPos, blockSize);
+
+    readPos += blockSize;
+
+    const auto start = Clock::now();
+    process(work);
+    elapsed += Clock::now() - start;
+  }
+
+  const auto ns =
+      (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+          .count();
+  const auto processedSamples = (double)numBlocks * blockSize;
+
+  Result result;
+  result.nsPerSample = ns / processedSamples;
+  result.realtimeFactor = (processedSamples / sampleRate) / (ns * 1.0e-9);
+  return result;
+}
+
+juce::var makeEntry(const juce::String &stage, const char *precision, int mode,
+                    double sampleRate, int blockSize, int processRate,
+                    const Result &result) {
+  auto *entry = new juce::DynamicObject();
+  entry->setProperty("stage", stage);
+  entry->setProperty("precision", precision);
+  entry->setProperty("mode", mode);
+  entry->setProperty("sample_rate", sampleRate);
+  entry->setProperty("block_size", blockSize);
+  entry->setProperty("process_rate", processRate);
+  entry->setProperty("ns_per_sample", result.nsPerSample);
+  entry->setProperty("realtime_factor", result.realtimeFactor);
+  return juce::var(entry);
+}
+
+bool wants(const Options &options, const juce::String &stage) {
+  return options.stageFilter.isEmpty() ||
+         stage.equalsIgnoreCase(options.stageFilter);
+}
+
+template <typename SampleType> bool wantsPrecision(const Options &options) {
+  return options.precisionFilter.isEmpty() ||
+         options.precisionFilter.equalsIgnoreCase(precisionName<SampleType>());
+}
+
+// Bytes per sample per channel that the host-rate stages read and write in
+// the engine's current mode, counting each pass over a channel's sub-block.
+// Modelled on the stage code, not measured; the gain computers' own scratch
+// and everything before the downsampler are the same on both paths and left
+// out.
+template <typename SampleType>
+int modelHostRateBytes(const DSP::VCoreEngine<SampleType> &engine,
+                       const DSP::ModeSettings &settings) {
+  if (settings.bypass)
+    return 0;
+
+  const auto widen =
+      settings.width >= DSP::StereoWidener<SampleType>::minimumWidth;
+  const auto makeup = settings.makeupGainDB != 0.0f;
+  const auto live = engine.isLiveMode();
+  int passes = 0;
+
+  // Band split: read the block, write it back and write the high band.
+  // Adding the delayed band: read the dry and wet, write the sum.
+  if (widen)
+    passes += 3 + 3;
+
+  if (engine.isFusedChain()) {
+    // The makeup gain rides along with the widener or the limiter input,
+    // and with the widener on, its output is the limiter's input
+    if (live)
+      passes += 3; // Peak read, then read and write the limited output
+    else
+      passes += widen ? 4 : 6; // [copy in,] detector copy, delayed output
+  } else {
+    if (makeup)
+      passes += 2;
+    passes += live ? 3 : 6;
+  }
+
+  return passes * (int)sizeof(SampleType);
+}
+
+Options parseOptions(int argc, char *argv[]) {
+  Options options;
+
+  for (int i = 1; i < argc; ++i) {
+    const juce::String arg(argv[i]);
+
+    if (arg == "--seconds" && i + 1 < argc)
+      options.secondsPerCase = juce::String(argv[++i]).getDoubleValue();
+    else if (arg == "--stage" && i + 1 < argc)
+      options.stageFilter = argv[++i];
+    else if (arg == "--precision" && i + 1 < argc)
+      options.precisionFilter = argv[++i];
+    else if (arg == "--quick")
+      options.quick = true;
+    else if (arg == "--aliasing")
+      options.aliasing = true;
+    else if (arg == "--latency")
+      options.latency = true;
+    else if (arg == "--verify")
+      options.verify = true;
+    else if (arg == "--images")
+      options.images = true;
+  }
+
+  if (options.quick)
+    options.secondsPerCase = juce::jmin(options.secondsPerCase, 0.25);
+
+  return options;
+}
+
+template <typename SampleType>
+void runSweep(const Options &options, juce::Array<juce::var> &results) {
+  if (!wantsPrecision<SampleType>(options))
+    return;
+
+  using Buffer = juce::AudioBuffer<SampleType>;
+  using Block = juce::dsp::AudioBlock<SampleType>;
+  using Engine = DSP::VCoreEngine<SampleType>;
+
+  constexpr auto precision = precisionName<SampleType>();
+
+  for (auto sampleRate : sampleRates) {
+    Buffer source(numChannels, (int)sampleRate);
+    fillTestSignal(source);
+
+    Buffer silence(numChannels, (int)sampleRate);
+    silence.clear();
+
+    Buffer immersiveSource(immersiveChannels, (int)sampleRate);
+    fillTestSignal(immersiveSource);
+
+    for (auto blockSize : blockSizes) {
+      juce::dsp::ProcessSpec hostSpec{sampleRate, (juce::uint32)blockSize,
+                                      (juce::uint32)numChannels};
+
+      // The engine owns the oversampling configuration; stages are timed at
+      // the rate and block length it runs them at.
+      Engine engine;
+      engine.prepare(hostSpec);
+
+      const auto factor = (int)engine.getOversamplingFactor();
+
+      // The engine never hands a stage more than one sub-block at a time
+      const auto stageBlockSize =
+          juce::jmin(blockSize, Engine::subBlockSize);
+
+      auto stageSpec = hostSpec;
+      stageSpec.maximumBlockSize = (juce::uint32)stageBlockSize;
+
+      auto osSpec = stageSpec;
+      osSpec.sampleRate *= (double)factor;
+      osSpec.maximumBlockSize *= (juce::uint32)factor;
+
+      Buffer work(numChannels, blockSize);
+      Buffer stageWork(numChannels, stageBlockSize);
+      Buffer osSource(numChannels, (int)sampleRate * factor);
+      Buffer osWork(numChannels, stageBlockSize * factor);
+      fillTestSignal(osSource);
+
+      const auto osRate = (int)osSpec.sampleRate;
+
+      // Same engine settings on a 7.1.4 stem, all channels linked
+      Engine immersive;
+      Buffer immersiveWork(immersiveChannels, blockSize);
+      if (wants(options, "VCoreEngine (7.1.4)")) {
+        immersive.setWidenerPairs(immersivePairs);
+        immersive.prepare({sampleRate, (juce::uint32)blockSize,
+                           (juce::uint32)immersiveChannels});
+      }
+
+      // Stage results are normalised to host samples: each host sample
+      // costs `factor` stage samples.
+      auto toHostRate = [factor](Result r) {
+        r.nsPerSample *= (double)factor;
+        r.realtimeFactor /= (double)factor;
+        return r;
+      };
+
+      for (int mode = 0; mode < Engine::numModes; ++mode) {
+        const auto settings = Engine::getModeSettings(mode);
+
+        // Both tanh kernels, so the fast path can be compared against the
+        // exact reference it replaced.
+        for (auto kernel :
+             {DSP::SaturatorKernel::fast, DSP::SaturatorKernel::reference}) {
+          const juce::String stage = kernel == DSP::SaturatorKernel::fast
+                                         ? "Saturator"
+                                         : "Saturator (reference)";
+          if (!wants(options, stage))
+            continue;
+
+          DSP::Saturator<SampleType> saturator;
+          saturator.prepare(osSpec);
+          saturator.setDrive(settings.saturationDrive);
+          saturator.setKernel(kernel);
+
+          auto r = timeCase(
+              osSource, stageBlockSize * factor, osSpec.sampleRate,
+              options.secondsPerCase,
+              [&](Buffer &b) {
+                Block block(b);
+                juce::dsp::ProcessContextReplacing<SampleType> context(block);
+                saturator.process(context);
+              },
+              osWork);
+          results.add(makeEntry(stage, precision, mode, sampleRate,
+                                blockSize, osRate, toHostRate(r)));
+        }
+
+        if (wants(options, "StereoWidener")) {
+          // Linear, so it runs at the host rate after downsampling
+          DSP::StereoWidener<SampleType> widener;
+          widener.prepare(stageSpec);
+          widener.setWidth(settings.width);
+
+          auto r = timeCase(
+              source, stageBlockSize, sampleRate, options.secondsPerCase,
+              [&](Buffer &b) {
+                Block block(b);
+                widener.process(block);
+              },
+              stageWork);
+          results.add(makeEntry("StereoWidener", precision, mode,
+                                sampleRate, blockSize, (int)sampleRate, r));
+        }
+
+        if (wants(options, "W1Limiter")) {
+          // Runs at the host rate, after downsampling
+          DSP::W1Limiter<SampleType> limiter;
+          limiter.prepare(stageSpec);
+          limiter.setThreshold(settings.thresholdDB);
+          const auto makeup =
+              juce::Decibels::decibelsToGain(settings.makeupGainDB);
+
+          auto r = timeCase(
+              source, stageBlockSize, sampleRate, options.secondsPerCase,
+              [&](Buffer &b) {
+                b.applyGain(makeup);
+                Block block(b);
+                limiter.process(block);
+              },
+              stageWork);
+          results.add(makeEntry("W1Limiter", precision, mode, sampleRate,
+                                blockSize, (int)sampleRate, r));
+        }
+
+        // The oversampler has no mode-dependent settings; time it once.
+        if (mode == 0 && wants(options, "Oversampling")) {
+          DSP::Oversampler<SampleType> oversampling;
+          oversampling.prepare(numChannels, engine.getOversamplingFactorLog2(),
+                               engine.getOversamplingFilter(),
+                               (size_t)stageBlockSize);
+
+          auto r = timeCase(
+              source, stageBlockSize, sampleRate, options.secondsPerCase,
+              [&](Buffer &b) {
+                Block block(b);
+                oversampling.processSamplesUp(block);
+                oversampling.processSamplesDown(block);
+              },
+              stageWork);
+          results.add(makeEntry("Oversampling", precision, mode,
+                                sampleRate, blockSize,
+                                (int)sampleRate * factor, r));
+        }
+
+        if (wants(options, "VCoreEngine")) {
+          engine.reset();
+          engine.setParameters(mode);
+
+          auto r = timeCase(
+              source, blockSize, sampleRate, options.secondsPerCase,
+              [&](Buffer &b) { engine.process(b); }, work);
+          auto entry = makeEntry("VCoreEngine", precision, mode, sampleRate,
+                                 blockSize, (int)sampleRate, r);
+          const auto footprint = engine.getMemoryFootprint();
+          auto *object = entry.getDynamicObject();
+          object->setProperty("host_rate_bytes_per_sample",
+                              modelHostRateBytes(engine, settings));
+          object->setProperty("state_arena_bytes",
+                              (juce::int64)footprint.stateArenaBytes);
+          object->setProperty("delay_line_bytes",
+                              (juce::int64)footprint.delayLineBytes);
+          object->setProperty("shared_table_bytes",
+                              (juce::int64)footprint.sharedTableBytes);
+          results.add(entry);
+        }
+
+        // The unfused reference, where the widener, makeup gain and limiter
+        // each make their own pass over the sub-block
+        if (wants(options, "VCoreEngine (staged)")) {
+          engine.reset();
+          engine.setParameters(mode);
+          engine.setFusedChain(false);
+
+          auto r = timeCase(
+              source, blockSize, sampleRate, options.secondsPerCase,
+              [&](Buffer &b) { engine.process(b); }, work);
+          auto entry = makeEntry("VCoreEngine (staged)", precision, mode,
+                                 sampleRate, blockSize, (int)sampleRate, r);
+          entry.getDynamicObject()->setProperty(
+              "host_rate_bytes_per_sample",
+              modelHostRateBytes(engine, settings));
+          results.add(entry);
+          engine.setFusedChain(true);
+        }
+
+        // A silent channel: once the tail has flushed the engine sleeps,
+        // so this is the cost of the silence check alone.
+        if (wants(options, "VCoreEngine (idle)")) {
+          engine.reset();
+          engine.setParameters(mode);
+
+          auto r = timeCase(
+              silence, blockSize, sampleRate, options.secondsPerCase,
+              [&](Buffer &b) { engine.process(b); }, work);
+          results.add(makeEntry("VCoreEngine (idle)", precision, mode,
+                                sampleRate, blockSize, (int)sampleRate, r));
+        }
+
+        // Per host sample, so for all 12 channels together
+        if (wants(options, "VCoreEngine (7.1.4)")) {
+          immersive.reset();
+          immersive.setParameters(mode);
+
+          auto r = timeCase(
+              immersiveSource, blockSize, sampleRate, options.secondsPerCase,
+              [&](Buffer &b) { immersive.process(b); }, immersiveWork);
+          results.add(makeEntry("VCoreEngine (7.1.4)", precision, mode,
+                                sampleRate, blockSize, (int)sampleRate, r));
+        }
+      }
+    }
+  }
+}
+
+//==============================================================================
+// Aliasing study
+
+constexpr int fftOrder = 14;
+constexpr int fftSize = 1 << fftOrder;
+
+// Energy of everything that isn't DC or a true harmonic of the test tone,
+// relative to the harmonic energy, in dB. The tone sits exactly on
+// `toneBin` and a Blackman-Harris window keeps each line within a few bins.
+double measureAliasingDb(const float *signal, int toneBin) {
+  constexpr int lineWidth = 4;
+
+  std::vector<float> data((size_t)fftSize * 2, 0.0f);
+  std::copy(signal, signal + fftSize, data.begin());
+
+  juce::dsp::WindowingFunction<float> window(
+      (size_t)fftSize, juce::dsp::WindowingFunction<float>::blackmanHarris,
+      false);
+  window.multiplyWithWindowingTable(data.data(), (size_t)fftSize);
+
+  juce::dsp::FFT fft(fftOrder);
+  fft.performFrequencyOnlyForwardTransform(data.data());
+
+  double harmonicEnergy = 0.0;
+  double aliasEnergy = 0.0;
+
+  for (int bin = lineWidth + 1; bin < fftSize / 2; ++bin) {
+    const auto energy = (double)data[(size_t)bin] * data[(size_t)bin];
+    const auto nearest = (int)std::lround((double)bin / toneBin) * toneBin;
+
+    if (nearest > 0 && std::abs(bin - nearest) <= lineWidth)
+      harmonicEnergy += energy;
+    else
+      aliasEnergy += energy;
+  }
+
+  return 10.0 * std::log10(aliasEnergy / harmonicEnergy);
+}
+
+// Runs a loud high sine through upsampling -> saturator -> downsampling for
+// every kernel and oversampling factor, with the BROADCAST drive.
+juce::Array<juce::var> runAliasingStudy(const Options &options) {
+  constexpr double sampleRate = 48000.0;
+  constexpr int blockSize = 256;
+  constexpr int toneBin = 1503; // ~4.4 kHz, odd so harmonics don't overlap
+  constexpr float amplitude = 0.9f;
+
+  const auto drive =
+      DSP::VCoreEngine<float>::getModeSettings(4).saturationDrive;
+
+  juce::AudioBuffer<float> tone(numChannels, fftSize * 2);
+  for (int ch = 0; ch < numChannels; ++ch)
+    for (int i = 0; i < tone.getNumSamples(); ++i)
+      tone.setSample(ch, i,
+                     amplitude * (float)std::sin(
+                                     juce::MathConstants<double>::twoPi *
+                                     toneBin * i / fftSize));
+
+  const std::pair<DSP::SaturatorKernel, const char *> kernels[] = {
+      {DSP::SaturatorKernel::reference, "reference"},
+      {DSP::SaturatorKernel::fast, "fast"},
+      {DSP::SaturatorKernel::adaa, "adaa"}};
+
+  juce::Array<juce::var> results;
+
+  for (const auto &[kernel, kernelName] : kernels) {
+    for (size_t factorLog2 = 0; factorLog2 <= 3; ++factorLog2) {
+      DSP::Oversampler<float> oversampling;
+      oversampling.prepare(numChannels, factorLog2,
+                           DSP::OversamplingFilter::iir, (size_t)blockSize);
+
+      const auto factor = (int)oversampling.getOversamplingFactor();
+
+      DSP::Saturator<float> saturator;
+      saturator.prepare({sampleRate * factor,
+                         (juce::uint32)(blockSize * factor),
+                         (juce::uint32)numChannels});
+      saturator.setDrive(drive);
+      saturator.setKernel(kernel);
+
+      auto process = [&](juce::AudioBuffer<float> &b) {
+        juce::dsp::AudioBlock<float> block(b);
+
+        for (size_t pos = 0; pos < block.getNumSamples(); pos += blockSize) {
+          auto sub = block.getSubBlock(
+              pos, juce::jmin((size_t)blockSize, block.getNumSamples() - pos));
+          auto osBlock = oversampling.processSamplesUp(sub);
+          juce::dsp::ProcessContextReplacing<float> context(osBlock);
+          saturator.process(context);
+          oversampling.processSamplesDown(sub);
+        }
+      };
+
+      // First half lets the filters settle, the second half is analysed
+      juce::AudioBuffer<float> output;
+      output.makeCopyOf(tone);
+      process(output);
+      const auto aliasingDb =
+          measureAliasingDb(output.getReadPointer(0, fftSize), toneBin);
+
+      juce::AudioBuffer<float> work(numChannels, blockSize);
+      oversampling.reset();
+      saturator.reset();
+      const auto timing =
+          timeCase(tone, blockSize, sampleRate, options.secondsPerCase,
+                   process, work);
+
+      auto *entry = new juce::DynamicObject();
+      entry->setProperty("kernel", kernelName);
+      entry->setProperty("oversampling", factor);
+      entry->setProperty("aliasing_db", aliasingDb);
+      entry->setProperty("ns_per_sample", timing.nsPerSample);
+      entry->setProperty("realtime_factor", timing.realtimeFactor);
+      results.add(juce::var(entry));
+    }
+  }
+
+  return results;
+}
+
+//==============================================================================
+// Image rejection
+
+// Loudest image of a tone after upsampling by `factor`, relative to the
+// tone, in dB. The tone sits exactly on `toneBin` and `signal` is periodic
+// in `length` once the filters have settled, so a plain DFT at the tone and
+// image bins measures them with no window leakage, well below what the
+// float FFT could resolve.
+double measureImageDb(const double *signal, int length, int toneBin,
+                      int factor) {
+  auto level = [&](int bin) {
+    double re = 0.0, im = 0.0;
+    for (int i = 0; i < length; ++i) {
+      // Reduced first, so the phase keeps its precision
+      const auto turns = (double)(((juce::int64)bin * i) % length) / length;
+      re += signal[i] * std::cos(juce::MathConstants<double>::twoPi * turns);
+      im -= signal[i] * std::sin(juce::MathConstants<double>::twoPi * turns);
+    }
+    return std::hypot(re, im);
+  };
+
+  // Images sit either side of every multiple of the host rate
+  double worst = 0.0;
+  for (int m = 1; m < factor; ++m)
+    for (auto bin : {m * length / factor - toneBin,
+                     m * length / factor + toneBin})
+      worst = std::max(worst, level(bin));
+
+  return 20.0 * std::log10(worst / level(toneBin));
+}
+
+// The worst image quoted for each filter and factor, 1 to 20 kHz at 48 kHz,
+// as measured by runImageRejection() below. Each is better than the spec of
+// the juce::dsp::Oversampling stage it replaces (see Oversampler.h); the
+// check is there so a change to the designs can't quietly make them worse.
+double getImageRejectionLimitDb(DSP::OversamplingFilter filter,
+                                size_t factorLog2) {
+  if (filter == DSP::OversamplingFilter::iir)
+    return factorLog2 == 1 ? -80.0 : -70.0;
+
+  return factorLog2 == 1 ? -97.0 : -96.0;
+}
+
+// Upsamples sines every kHz up to 20 kHz with each filter and factor, in
+// double so rounding doesn't set the floor. Reports each point and the worst
+// one, which is the figure to quote, and fails any worse than its limit.
+juce::Array<juce::var> runImageRejection(bool &allPassed) {
+  constexpr double sampleRate = 48000.0;
+  constexpr int blockSize = 256;
+  constexpr int length = 1 << 14; // Oversampled samples analysed
+  constexpr int settleBlocks = 3; // Host lengths run first
+  const std::pair<DSP::OversamplingFilter, const char *> filters[] = {
+      {DSP::OversamplingFilter::iir, "iir"},
+      {DSP::OversamplingFilter::linearPhase, "linear_phase"}};
+
+  juce::Array<juce::var> results;
+
+  for (const auto &[filter, filterName] : filters) {
+    for (size_t factorLog2 = 1;
+         factorLog2 <= DSP::Oversampler<double>::maxFactorLog2;
+         ++factorLog2) {
+      const auto factor = 1 << factorLog2;
+      const auto hostLength = length / factor;
+
+      juce::Array<juce::var> points;
+      double worstDb = -1000.0, worstFrequency = 0.0;
+
+      for (double frequency = 1000.0; frequency <= 20000.0;
+           frequency += 1000.0) {
+        DSP::Oversampler<double> oversampling;
+        oversampling.prepare(1, factorLog2, filter, (size_t)blockSize);
+
+        const auto toneBin =
+            juce::roundToInt(frequency / (sampleRate * factor) * length);
+        const auto cyclesPerSample = (double)toneBin * factor / length;
+
+        juce::AudioBuffer<double> input(1, blockSize);
+        std::vector<double> output((size_t)length);
+        const auto totalLength = hostLength * (settleBlocks + 1);
+
+        for (int pos = 0; pos < totalLength; pos += blockSize) {
+          for (int i = 0; i < blockSize; ++i)
+            input.setSample(0, i,
+                            0.5 * std::sin(juce::MathConstants<double>::twoPi *
+                                           cyclesPerSample * (pos + i)));
+
+          juce::dsp::AudioBlock<double> block(input);
+          const auto up = oversampling.processSamplesUp(block);
+
+          const auto analysed = pos - hostLength * settleBlocks;
+          if (analysed >= 0)
+            std::copy(up.getChannelPointer(0),
+                      up.getChannelPointer(0) + blockSize * factor,
+                      output.begin() + analysed * factor);
+        }
+
+        const auto measured = (double)toneBin * sampleRate * factor / length;
+        const auto imageDb =
+            measureImageDb(output.data(), length, toneBin, factor);
+
+        auto *point = new juce::DynamicObject();
+        point->setProperty("frequency", measured);
+        point->setProperty("image_db", imageDb);
+        points.add(juce::var(point));
+
+        if (imageDb > worstDb) {
+          worstDb = imageDb;
+          worstFrequency = measured;
+        }
+      }
+
+      const auto limitDb = getImageRejectionLimitDb(filter, factorLog2);
+      const auto passed = worstDb <= limitDb;
+      allPassed = allPassed && passed;
+
+      auto *entry = new juce::DynamicObject();
+      entry->setProperty("filter", filterName);
+      entry->setProperty("oversampling", factor);
+      entry->setProperty("sample_rate", sampleRate);
+      entry->setProperty("worst_image_db", worstDb);
+      entry->setProperty("worst_frequency", worstFrequency);
+      entry->setProperty("limit_db", limitDb);
+      entry->setProperty("passed", passed);
+      entry->setProperty("points", points);
+      results.add(juce::var(entry));
+    }
+  }
+
+  return results;
+}
+
+//==============================================================================
+// Latency check
+
+// Feeds a small impulse through the engine and measures the delay as the
+// centroid of the response, which equals the group delay at DC. That is what
+// a host compensates with, so it has to match the reported latency, both
+// through the stages (all neutral settings) and on the bypass path.
+template <typename SampleType>
+double measureLatency(DSP::VCoreEngine<SampleType> &engine, double sampleRate,
+                      bool bypass) {
+  constexpr int blockSize = 512;
+  constexpr int impulsePos = 64;
+  constexpr int length = 1 << 15;
+
+  engine.prepare(
+      {sampleRate, (juce::uint32)blockSize, (juce::uint32)numChannels});
+  typename DSP::VCoreEngine<SampleType>::ModeSettings settings;
+  settings.bypass = bypass;
+  engine.setParameters(settings);
+
+  juce::AudioBuffer<SampleType> buffer(numChannels, length);
+  buffer.clear();
+  for (int ch = 0; ch < numChannels; ++ch)
+    buffer.setSample(ch, impulsePos, SampleType(0.01));
+
+  for (int pos = 0; pos < length; pos += blockSize) {
+    juce::AudioBuffer<SampleType> block(buffer.getArrayOfWritePointers(),
+                                        numChannels, pos, blockSize);
+    engine.process(block);
+  }
+
+  double weighted = 0.0, total = 0.0;
+  const auto *out = buffer.getReadPointer(0);
+  for (int i = 0; i < length; ++i) {
+    weighted += (double)i * out[i];
+    total += out[i];
+  }
+
+  return weighted / total - impulsePos;
+}
+
+template <typename SampleType>
+void runLatencyCheck(juce::Array<juce::var> &results, bool &allPassed) {
+  const double rates[] = {44100.0, 48000.0, 96000.0, 192000.0};
+  const std::pair<DSP::OversamplingFilter, const char *> filters[] = {
+      {DSP::OversamplingFilter::iir, "iir"},
+      {DSP::OversamplingFilter::linearPhase, "linear_phase"}};
+
+  using Engine = DSP::VCoreEngine<SampleType>;
+
+  auto check = [&](Engine &engine, double sampleRate,
+                   const char *filterName, double tolerance) {
+    for (auto bypass : {false, true}) {
+      const auto measured = measureLatency(engine, sampleRate, bypass);
+      const auto reported = engine.getLatencySamples();
+      const auto passed = std::abs(measured - reported) <= tolerance;
+      allPassed = allPassed && passed;
+
+      auto *entry = new juce::DynamicObject();
+      entry->setProperty("sample_rate", sampleRate);
+      entry->setProperty("oversampling", (int)engine.getOversamplingFactor());
+      entry->setProperty("filter", filterName);
+      entry->setProperty("precision", precisionName<SampleType>());
+      entry->setProperty("live_mode", engine.isLiveMode());
+      entry->setProperty("path", bypass ? "bypass" : "chain");
+      entry->setProperty("reported_latency", reported);
+      entry->setProperty("measured_latency", measured);
+      entry->setProperty("latency_ms", 1000.0 * reported / sampleRate);
+      entry->setProperty("passed", passed);
+      results.add(juce::var(entry));
+    }
+  };
+
+  for (auto sampleRate : rates) {
+    for (const auto &[filter, filterName] : filters) {
+      for (size_t factorLog2 = 0;
+           factorLog2 <= Engine::maxOversamplingFactorLog2; ++factorLog2) {
+        Engine engine;
+        engine.setOversampling(factorLog2, filter);
+        check(engine, sampleRate, filterName, 0.1);
+      }
+    }
+
+    // The live path: the ADAA saturator's half sample, rounded up to one
+    Engine engine;
+    engine.setLiveMode(true);
+    check(engine, sampleRate, "iir", 0.1);
+
+    // ADAA in the oversampled chain adds half a sample at the high rate
+    for (size_t factorLog2 = 0;
+         factorLog2 <= Engine::maxOversamplingFactorLog2; ++factorLog2) {
+      Engine adaaEngine;
+      adaaEngine.setOversampling(factorLog2, DSP::OversamplingFilter::iir);
+      adaaEngine.setSaturatorKernel(DSP::SaturatorKernel::adaa);
+      check(adaaEngine, sampleRate, "iir (adaa)", 0.1);
+    }
+  }
+}
+//==============================================================================
+// Equivalence checks
+
+struct VerifyLayout {
+  int numChannels;
+  std::vector<DSP::ChannelPair> pairs;
+};
+
+// Mono widens channel 0 on its own; 5.1 is L R C LFE Ls Rs
+const VerifyLayout verifyLayouts[] = {{1, {{0, 1}}},
+                                      {2, {{0, 1}}},
+                                      {6, {{0, 1}, {4, 5}}},
+                                      {immersiveChannels, immersivePairs}};
+
+// One engine configuration: live mode, or an oversampling factor and filter
+struct VerifyConfig {
+  bool live = false;
+  size_t factorLog2 = 0;
+  DSP::OversamplingFilter filter = DSP::OversamplingFilter::iir;
+};
+
+std::vector<VerifyConfig> getVerifyConfigs() {
+  std::vector<VerifyConfig> configs{{true}};
+
+  for (size_t factorLog2 = 0;
+       factorLog2 <= DSP::Oversampler<float>::maxFactorLog2; ++factorLog2)
+    for (auto filter : {DSP::OversamplingFilter::iir,
+                        DSP::OversamplingFilter::linearPhase})
+      configs.push_back({false, factorLog2, filter});
+
+  return configs;
+}
+
+template <typename SampleType>
+void prepareForVerify(DSP::VCoreEngine<SampleType> &engine,
+                      const VerifyConfig &config, const VerifyLayout &layout,
+                      int mode) {
+  engine.setOversampling(config.factorLog2, config.filter);
+  engine.setLiveMode(config.live);
+  engine.setWidenerPairs(layout.pairs);
+  engine.prepare(
+      {48000.0, (juce::uint32)1024, (juce::uint32)layout.numChannels});
+  engine.setParameters(mode);
+}
+
+// Runs `input` through `engine` in blocks of `blockSize` (the last one
+// shorter), in place
+template <typename SampleType>
+void processInBlocks(DSP::VCoreEngine<SampleType> &engine,
+                     juce::AudioBuffer<SampleType> &buffer, int blockSize) {
+  for (int pos = 0; pos < buffer.getNumSamples(); pos += blockSize) {
+    juce::AudioBuffer<SampleType> block(
+        buffer.getArrayOfWritePointers(), buffer.getNumChannels(), pos,
+        juce::jmin(blockSize, buffer.getNumSamples() - pos));
+    engine.process(block);
+  }
+}
+
+template <typename SampleType>
+double getMaxDifference(const juce::AudioBuffer<SampleType> &a,
+                        const juce::AudioBuffer<SampleType> &b) {
+  double maxDifference = 0.0;
+  for (int ch = 0; ch < a.getNumChannels(); ++ch)
+    for (int i = 0; i < a.getNumSamples(); ++i)
+      maxDifference = std::max(
+          maxDifference, std::abs((double)a.getSample(ch, i) -
+                                  (double)b.getSample(ch, i)));
+  return maxDifference;
+}
+
+// Everything one check found: the worst difference, and which cases went
+// over the tolerance
+struct VerifySummary {
+  juce::String check;
+  const char *precision = "";
+  double tolerance = 0.0;
+  int cases = 0;
+  double maxDifference = 0.0;
+  juce::Array<juce::var> failures;
+
+  // A case fails when the difference is over the tolerance, or with a
+  // `reason` for something else that went wrong
+  void add(double difference, const VerifyConfig &config, int numChannels,
+           int mode, int blockSize, const char *reason = nullptr) {
+    ++cases;
+    maxDifference = std::max(maxDifference, difference);
+    if (difference <= tolerance && reason == nullptr)
+      return;
+
+    auto *failure = new juce::DynamicObject();
+    if (reason != nullptr)
+      failure->setProperty("reason", reason);
+    failure->setProperty("mode", mode);
+    failure->setProperty("live_mode", config.live);
+    failure->setProperty("oversampling", 1 << config.factorLog2);
+    failure->setProperty("filter", config.filter == DSP::OversamplingFilter::iir
+                                       ? "iir"
+                                       : "linear_phase");
+    failure->setProperty("channels", numChannels);
+    failure->setProperty("block_size", blockSize);
+    failure->setProperty("difference", difference);
+    failures.add(juce::var(failure));
+  }
+
+  juce::var toVar() const {
+    auto *entry = new juce::DynamicObject();
+    entry->setProperty("check", check);
+    entry->setProperty("precision", precision);
+    entry->setProperty("cases", cases);
+    entry->setProperty("max_difference", maxDifference);
+    entry->setProperty("tolerance", tolerance);
+    entry->setProperty("passed", failures.isEmpty());
+    entry->setProperty("failures", failures);
+    return juce::var(entry);
+  }
+};
+
+// The fused host-rate chain against the staged reference, on the same
+// input. They do the same arithmetic in a different order of passes, so
+// they should agree to the last bit; the tolerance only leaves room for a
+// compiler that contracts the fused loop into FMAs.
+template <typename SampleType>
+VerifySummary verifyFusedChain(const Options &options) {
+  using Engine = DSP::VCoreEngine<SampleType>;
+
+  VerifySummary summary;
+  summary.check = "fused_vs_staged";
+  summary.precision = precisionName<SampleType>();
+  summary.tolerance = 16.0 * std::numeric_limits<SampleType>::epsilon();
+
+  const std::vector<int> blockSizes =
+      options.quick ? std::vector<int>{37, 333}
+                    : std::vector<int>{1, 37, 64, 333, 1024};
+  constexpr int length = 8192;
+
+  for (const auto &config : getVerifyConfigs()) {
+    for (const auto &layout : verifyLayouts) {
+      juce::AudioBuffer<SampleType> input(layout.numChannels, length);
+      fillTestSignal(input);
+
+      for (auto blockSize : blockSizes) {
+        for (int mode = 0; mode < Engine::numModes; ++mode) {
+          Engine fused, staged;
+          prepareForVerify(fused, config, layout, mode);
+          prepareForVerify(staged, config, layout, mode);
+          staged.setFusedChain(false);
+
+          juce::AudioBuffer<SampleType> a, b;
+          a.makeCopyOf(input);
+          b.makeCopyOf(input);
+          processInBlocks(fused, a, blockSize);
+          processInBlocks(staged, b, blockSize);
+
+          summary.add(getMaxDifference(a, b), config, layout.numChannels,
+                      mode, blockSize);
+        }
+      }
+    }
+  }
+
+  return summary;
+}
+
+// An engine that sleeps through silence against one that keeps running, on
+// bursts of signal with gaps longer than the tail, in blocks of varying odd
+// sizes. Sleeping drops whatever the reference still has left below the
+// silence threshold, so that is the tolerance, plus some rounding: the
+// reference's limiter releases sample by sample over the gap and the
+// sleeping one in one step, and in float the two end up a few dozen ulps
+// apart. Fails as well if the engine never actually went to sleep.
+template <typename SampleType> VerifySummary verifySleep() {
+  using Engine = DSP::VCoreEngine<SampleType>;
+
+  VerifySummary summary;
+  summary.check = "sleep_vs_awake";
+  summary.precision = precisionName<SampleType>();
+  summary.tolerance = (double)Engine::silenceThreshold +
+                      64.0 * std::numeric_limits<SampleType>::epsilon();
+
+  for (const auto &config : getVerifyConfigs()) {
+    for (const auto &layout : verifyLayouts) {
+      for (int mode = 0; mode < Engine::numModes; ++mode) {
+        Engine sleeping, awake;
+        prepareForVerify(sleeping, config, layout, mode);
+        prepareForVerify(awake, config, layout, mode);
+        awake.setAutoSleep(false);
+
+        // Burst, gap, click, gap, burst, gap
+        const auto gap = sleeping.getTailSamples() + 3000;
+        const int bursts[][2] = {{0, 3000},
+                                 {3000 + gap, 100},
+                                 {3100 + 2 * gap, 5000}};
+        const auto length = 8100 + 3 * gap;
+
+        juce::AudioBuffer<SampleType> a(layout.numChannels, length);
+        fillTestSignal(a);
+        for (int ch = 0; ch < layout.numChannels; ++ch) {
+          auto *data = a.getWritePointer(ch);
+          int pos = 0;
+          for (const auto &[start, burstLength] : bursts) {
+            std::fill(data + pos, data + start, SampleType(0));
+            pos = start + burstLength;
+          }
+          std::fill(data + pos, data + length, SampleType(0));
+        }
+
+        juce::AudioBuffer<SampleType> b;
+        b.makeCopyOf(a);
+
+        auto slept = false;
+        for (int pos = 0, blockSize = 37; pos < length;
+             blockSize = (blockSize * 7 + 13) % 700 + 1) {
+          const auto n = juce::jmin(blockSize, length - pos);
+          juce::AudioBuffer<SampleType> blockA(a.getArrayOfWritePointers(),
+                                               layout.numChannels, pos, n);
+          juce::AudioBuffer<SampleType> blockB(b.getArrayOfWritePointers(),
+                                               layout.numChannels, pos, n);
+          sleeping.process(blockA);
+          awake.process(blockB);
+          slept = slept || sleeping.isAsleep();
+          pos += n;
+        }
+
+        summary.add(getMaxDifference(a, b), config, layout.numChannels, mode,
+                    0, slept ? nullptr : "never slept");
+      }
+    }
+  }
+
+  return summary;
+}
+
+template <typename SampleType>
+void runVerify(const Options &options, juce::Array<juce::var> &results,
+               bool &allPassed) {
+  if (!wantsPrecision<SampleType>(options))
+    return;
+
+  for (const auto &summary :
+       {verifyFusedChain<SampleType>(options), verifySleep<SampleType>()}) {
+    allPassed = allPassed && summary.failures.isEmpty();
+    results.add(summary.toVar());
+  }
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const auto options = parseOptions(argc, argv);
+
+  auto *root = new juce::DynamicObject();
+  root->setProperty("version", VCORE_VERSION_STRING);
+  root->setProperty("seconds_per_case", options.secondsPerCase);
+
+  auto allPassed = true;
+
+  if (options.verify) {
+    juce::Array<juce::var> verify;
+    runVerify<float>(options, verify, allPassed);
+    runVerify<double>(options, verify, allPassed);
+    root->setProperty("verify", verify);
+  } else if (options.latency) {
+    juce::Array<juce::var> latency;
+    runLatencyCheck<float>(latency, allPassed);
+    runLatencyCheck<double>(latency, allPassed);
+    root->setProperty("latency", latency);
+  } else if (options.images) {
+    root->setProperty("image_rejection", runImageRejection(allPassed));
+  } else if (options.aliasing) {
+    root->setProperty("aliasing", runAliasingStudy(options));
+    root->setProperty("image_rejection", runImageRejection(allPassed));
+  } else {
+    juce::Array<juce::var> results;
+    runSweep<float>(options, results);
+    runSweep<double>(options, results);
+    root->setProperty("results", results);
+  }
+
+  std::cout << juce::JSON::toString(juce::var(root)).toStdString()
+            << std::endl;
+  return allPassed ? 0 : 1;
+}
@@ -0,0 +1,374 @@
+// vcore_pipe: V-CORE as a Unix filter, for ffmpeg/sox pipelines.
+//
+// Reads interleaved little-endian PCM from stdin, runs it through the engine
+// in fixed chunks and writes the same format to stdout, e.g.
+//
+//   ffmpeg -i in.mkv -f s16le -ar 48000 -ac 2 - |
+//     vcore_pipe --mode 2 --format s16 --rate 48000 --channels 2 |
+//     ffmpeg -f s16le -ar 48000 -ac 2 -i - out.wav
+//
+// Reading, processing and writing each run on their own thread and hand
+// chunks along a fixed ring of slots, so they overlap and memory use doesn't
+// depend on how long the stream is. The reader can only get as far ahead of
+// the writer as the ring is long, so the output lags the input by at most
+// the engine latency plus numSlots chunks.
+//
+// The engine latency is trimmed off the start and flushed out at the end of
+// the input, so the output has exactly as many frames as the input and
+// lines up with it. Defaults to the plugin's realtime quality (4x, IIR);
+// --live drops the latency to a single sample.
+//
+//   vcore_pipe --mode <0-4> [--format s16|s24|s32|f32] [--rate <hz>]
+//              [--channels <n>] [--chunk <frames>] [--live]
+//              [--oversampling <0-3>] [--filter iir|linear]
+
+#include "DSP/SpeakerPairs.h"
+#include "DSP/VCoreEngine.h"
+#include <JuceHeader.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if JUCE_WINDOWS
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace {
+using Engine = DSP::VCoreEngine<float>;
+
+// One chunk being read, one being processed, one being written, and one
+// spare so a stage that finishes early can start on the next chunk
+constexpr size_t numSlots = 4;
+
+struct Options {
+  int mode = -1;
+  juce::String format = "s16";
+  double sampleRate = 48000.0;
+  int numChannels = 2;
+  int chunkFrames = 1024;
+  bool live = false;
+  size_t oversamplingFactorLog2 = 2; // 4x
+  DSP::OversamplingFilter filter = DSP::OversamplingFilter::iir;
+};
+
+void printUsage() {
+  std::cerr << "usage: vcore_pipe --mode <0-4> [--format s16|s24|s32|f32] "
+               "[--rate <hz>]\n"
+               "                  [--channels <n>] [--chunk <frames>] "
+               "[--live]\n"
+               "                  [--oversampling <0-3>] "
+               "[--filter iir|linear]\n";
+}
+
+bool parseOptions(int argc, char *argv[], Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    const juce::String arg(argv[i]);
+
+    if (arg == "--mode" && i + 1 < argc)
+      options.mode = juce::String(argv[++i]).getIntValue();
+    else if (arg == "--format" && i + 1 < argc)
+      options.format = argv[++i];
+    else if (arg == "--rate" && i + 1 < argc)
+      options.sampleRate = juce::String(argv[++i]).getDoubleValue();
+    else if (arg == "--channels" && i + 1 < argc)
+      options.numChannels = juce::String(argv[++i]).getIntValue();
+    else if (arg == "--chunk" && i + 1 < argc)
+      options.chunkFrames = juce::String(argv[++i]).getIntValue();
+    else if (arg == "--live")
+      options.live = true;
+    else if (arg == "--oversampling" && i + 1 < argc)
+      options.oversamplingFactorLog2 = (size_t)juce::jlimit(
+          0, (int)Engine::maxOversamplingFactorLog2,
+          juce::String(argv[++i]).getIntValue());
+    else if (arg == "--filter" && i + 1 < argc)
+      options.filter = juce::String(argv[++i]) == "iir"
+                           ? DSP::OversamplingFilter::iir
+                           : DSP::OversamplingFilter::linearPhase;
+    else
+      return false;
+  }
+
+  return options.mode >= 0 && options.mode < Engine::numModes &&
+         options.sampleRate > 0.0 && options.numChannels > 0 &&
+         options.chunkFrames > 0;
+}
+
+// Converts between interleaved PCM on the pipes and the engine's channels
+struct Codec {
+  int bytesPerSample = 0;
+  void (*toFloat)(const char *, juce::AudioBuffer<float> &, int) = nullptr;
+  void (*fromFloat)(const juce::AudioBuffer<float> &, char *, int) = nullptr;
+};
+
+template <typename DataFormat> Codec makeCodec(int bytesPerSample) {
+  using Wire =
+      juce::AudioData::Format<DataFormat, juce::AudioData::LittleEndian>;
+  using Native = juce::AudioData::Format<juce::AudioData::Float32,
+                                         juce::AudioData::NativeEndian>;
+  using WireSource = juce::AudioData::InterleavedSource<Wire>;
+  using WireDest = juce::AudioData::InterleavedDest<Wire>;
+
+  Codec codec;
+  codec.bytesPerSample = bytesPerSample;
+
+  codec.toFloat = [](const char *bytes, juce::AudioBuffer<float> &buffer,
+                     int numFrames) {
+    const auto channels = buffer.getNumChannels();
+    juce::AudioData::deinterleaveSamples(
+        WireSource{static_cast<typename WireSource::DataType>(
+                       static_cast<const void *>(bytes)),
+                   channels},
+        juce::AudioData::NonInterleavedDest<Native>{
+            buffer.getArrayOfWritePointers(), channels},
+        numFrames);
+  };
+
+  codec.fromFloat = [](const juce::AudioBuffer<float> &buffer, char *bytes,
+                       int numFrames) {
+    const auto channels = buffer.getNumChannels();
+    juce::AudioData::interleaveSamples(
+        juce::AudioData::NonInterleavedSource<Native>{
+            buffer.getArrayOfReadPointers(), channels},
+        WireDest{static_cast<typename WireDest::DataType>(
+                     static_cast<void *>(bytes)),
+                 channels},
+        numFrames);
+  };
+
+  return codec;
+}
+
+bool getCodec(const juce::String &format, Codec &codec) {
+  if (format == "s16")
+    codec = makeCodec<juce::AudioData::Int16>(2);
+  else if (format == "s24")
+    codec = makeCodec<juce::AudioData::Int24>(3);
+  else if (format == "s32")
+    codec = makeCodec<juce::AudioData::Int32>(4);
+  else if (format == "f32")
+    codec = makeCodec<juce::AudioData::Float32>(4);
+  else
+    return false;
+  return true;
+}
+
+// The ring of chunks between the three stages. Chunk n goes through slot
+// n % numSlots; each stage waits until the stage before it is done with
+// the chunk, and the reader until the writer has freed the slot.
+class ChunkRing {
+public:
+  enum Stage { reading, processing, writing, numStages };
+
+  struct Slot {
+    std::vector<char> bytes; // Input in, output out, in place
+    int numFrames = 0;       // Input frames; the rest is padding
+    juce::int64 inputFramesSoFar = 0;
+    int outputOffset = 0; // Frames of this chunk that go to stdout
+    int outputFrames = 0;
+    bool last = false;
+  };
+
+  explicit ChunkRing(size_t bytesPerSlot) {
+    for (auto &slot : slots)
+      slot.bytes.resize(bytesPerSlot);
+  }
+
+  // Blocks until `stage` can have chunk `sequence`. False once stopped.
+  bool wait(Stage stage, size_t sequence) {
+    std::unique_lock lock(mutex);
+    changed.wait(lock, [&] { return stopped || isReady(stage, sequence); });
+    return !stopped;
+  }
+
+  Slot &getSlot(size_t sequence) { return slots[sequence % numSlots]; }
+
+  void finished(Stage stage) {
+    {
+      const std::scoped_lock lock(mutex);
+      ++completed[stage];
+    }
+    changed.notify_all();
+  }
+
+  // Wakes every stage up to give up, after an error
+  void stop() {
+    {
+      const std::scoped_lock lock(mutex);
+      stopped = true;
+    }
+    changed.notify_all();
+  }
+
+private:
+  bool isReady(Stage stage, size_t sequence) const {
+    switch (stage) {
+    case reading:
+      return sequence < completed[writing] + numSlots;
+    case processing:
+      return sequence < completed[reading];
+    default:
+      return sequence < completed[processing];
+    }
+  }
+
+  Slot slots[numSlots];
+  size_t completed[numStages] = {};
+  bool stopped = false;
+  std::mutex mutex;
+  std::condition_variable changed;
+};
+
+// Whole frames only; a partial frame at the very end is dropped
+int readFrames(char *dest, int maxFrames, int frameBytes) {
+  const auto wanted = (size_t)maxFrames * (size_t)frameBytes;
+  size_t got = 0;
+
+  while (got < wanted) {
+    const auto n = std::fread(dest + got, 1, wanted - got, stdin);
+    if (n == 0)
+      break;
+    got += n;
+  }
+
+  return (int)(got / (size_t)frameBytes);
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  Codec codec;
+
+  if (!parseOptions(argc, argv, options) || !getCodec(options.format, codec)) {
+    printUsage();
+    return 2;
+  }
+
+#if JUCE_WINDOWS
+  _setmode(_fileno(stdin), _O_BINARY);
+  _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+  juce::ScopedNoDenormals noDenormals;
+
+  const auto chunk = options.chunkFrames;
+  const auto frameBytes = codec.bytesPerSample * options.numChannels;
+
+  Engine engine;
+  engine.setOversampling(options.oversamplingFactorLog2, options.filter);
+  engine.setLiveMode(options.live);
+  engine.setWidenerPairs(DSP::getWidenerPairs(
+      juce::AudioChannelSet::canonicalChannelSet(options.numChannels)));
+  engine.prepare({options.sampleRate, (juce::uint32)chunk,
+                  (juce::uint32)options.numChannels});
+  engine.setParameters(options.mode);
+
+  const auto latency = (juce::int64)engine.getLatencySamples();
+
+  ChunkRing ring((size_t)chunk * (size_t)frameBytes);
+  bool readFailed = false, writeFailed = false;
+
+  // After the end of the input, keep going with silent chunks until the
+  // engine has put out the last input frame
+  std::thread reader([&] {
+    juce::int64 framesIn = 0, framesFed = 0;
+    auto endOfInput = false;
+
+    for (size_t sequence = 0; ring.wait(ChunkRing::reading, sequence);
+         ++sequence) {
+      auto &slot = ring.getSlot(sequence);
+
+      slot.numFrames =
+          endOfInput ? 0 : readFrames(slot.bytes.data(), chunk, frameBytes);
+      if (slot.numFrames < chunk) {
+        endOfInput = true;
+        readFailed = std::ferror(stdin) != 0;
+      }
+
+      framesIn += slot.numFrames;
+      framesFed += chunk;
+      slot.inputFramesSoFar = framesIn;
+      const auto last = endOfInput && framesFed >= framesIn + latency;
+      slot.last = last;
+
+      ring.finished(ChunkRing::reading);
+      if (last)
+        break;
+    }
+  });
+
+  std::thread writer([&] {
+    for (size_t sequence = 0; ring.wait(ChunkRing::writing, sequence);
+         ++sequence) {
+      const auto &slot = ring.getSlot(sequence);
+      const auto bytes = (size_t)slot.outputFrames * (size_t)frameBytes;
+
+      if (bytes > 0 &&
+          (std::fwrite(slot.bytes.data() + (size_t)slot.outputOffset *
+                                               (size_t)frameBytes,
+                       1, bytes, stdout) != bytes ||
+           std::fflush(stdout) != 0)) {
+        writeFailed = true;
+        ring.stop();
+        break;
+      }
+
+      // Once handed on, the slot may already be refilled
+      const auto last = slot.last;
+      ring.finished(ChunkRing::writing);
+      if (last)
+        break;
+    }
+  });
+
+  // Chunk n covers engine output frames [n * chunk, (n + 1) * chunk). Of
+  // those, the ones from `latency` on are input frames coming back out.
+  juce::AudioBuffer<float> buffer(options.numChannels, chunk);
+
+  for (size_t sequence = 0; ring.wait(ChunkRing::processing, sequence);
+       ++sequence) {
+    auto &slot = ring.getSlot(sequence);
+
+    buffer.clear();
+    codec.toFloat(slot.bytes.data(), buffer, slot.numFrames);
+    {
+      VCORE_REALTIME_STAGE("vcore_pipe process");
+      engine.process(buffer);
+    }
+    codec.fromFloat(buffer, slot.bytes.data(), chunk);
+
+    const auto chunkStart = (juce::int64)sequence * chunk;
+    const auto first = juce::jmax(latency, chunkStart);
+    const auto end =
+        juce::jmin(chunkStart + chunk, latency + slot.inputFramesSoFar);
+    slot.outputOffset = (int)(first - chunkStart);
+    slot.outputFrames = (int)juce::jmax((juce::int64)0, end - first);
+
+    const auto last = slot.last;
+    ring.finished(ChunkRing::processing);
+    if (last)
+      break;
+  }
+
+  writer.join();
+
+  // Stopping the ring doesn't wake a reader blocked in fread() on an input
+  // that stays open, so after a failed write it isn't joined: exit straight
+  // away. Nothing is left to write and stdout is already broken.
+  if (writeFailed) {
+    std::cerr << "vcore_pipe: error writing stdout" << std::endl;
+    std::_Exit(1);
+  }
+
+  reader.join();
+
+  if (readFailed)
+    std::cerr << "vcore_pipe: error reading stdin" << std::endl;
+
+  return readFailed ? 1 : 0;
+}
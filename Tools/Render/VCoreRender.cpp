@@ -0,0 +1,409 @@
+// vcore_render: runs audio files through the V-CORE engine, no DAW needed.
+//
+// Every input file (anything JUCE reads: WAV, FLAC, AIFF...) is rendered to
+// <name>_vcore.<ext> in the same format and bit depth, next to the input or
+// in --output. The engine latency is trimmed off, so the output lines up
+// with the input sample for sample and has the same length. Inputs that
+// would render to the same file (same name in different directories with
+// one --output) or overwrite one another are refused before anything starts.
+//
+// Files are shared out over a work-stealing pool with one engine per
+// worker. Each worker starts with its own share of the files, longest
+// first, and when it runs out it takes the shortest ones left in another
+// worker's queue, so no worker sits idle while another has files waiting.
+//
+// Renders at the offline quality the plugin uses (8x, linear phase) unless
+// told otherwise. Prints a line per file and the throughput at the end, as
+// a realtime factor overall and per core. Exits with a non-zero status if
+// any file failed.
+//
+//   vcore_render --mode <0-4> [--output <dir>] [--jobs <n>]
+//                [--oversampling <0-3>] [--filter iir|linear] <file>...
+
+#include "DSP/SpeakerPairs.h"
+#include "DSP/VCoreEngine.h"
+#include <JuceHeader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+using Engine = DSP::VCoreEngine<float>;
+
+// Samples read, processed and written per call
+constexpr int renderBlockSize = 4096;
+
+struct Options {
+  int mode = -1;
+  juce::File outputDir;
+  int jobs = 0; // 0: one per CPU
+  size_t oversamplingFactorLog2 = Engine::maxOversamplingFactorLog2;
+  DSP::OversamplingFilter filter = DSP::OversamplingFilter::linearPhase;
+  std::vector<juce::File> inputs;
+};
+
+struct RenderResult {
+  bool ok = false;
+  juce::String error;
+  juce::File output;
+  double audioSeconds = 0.0;
+  double busySeconds = 0.0; // Reading, processing and writing
+};
+
+void printUsage() {
+  std::cerr << "usage: vcore_render --mode <0-4> [--output <dir>] "
+               "[--jobs <n>]\n"
+               "                    [--oversampling <0-3>] "
+               "[--filter iir|linear] <file>...\n";
+}
+
+bool parseOptions(int argc, char *argv[], Options &options) {
+  const auto cwd = juce::File::getCurrentWorkingDirectory();
+
+  for (int i = 1; i < argc; ++i) {
+    const juce::String arg(argv[i]);
+
+    if (arg == "--mode" && i + 1 < argc)
+      options.mode = juce::String(argv[++i]).getIntValue();
+    else if (arg == "--output" && i + 1 < argc)
+      options.outputDir = cwd.getChildFile(argv[++i]);
+    else if (arg == "--jobs" && i + 1 < argc)
+      options.jobs = juce::String(argv[++i]).getIntValue();
+    else if (arg == "--oversampling" && i + 1 < argc)
+      options.oversamplingFactorLog2 = (size_t)juce::jlimit(
+          0, (int)Engine::maxOversamplingFactorLog2,
+          juce::String(argv[++i]).getIntValue());
+    else if (arg == "--filter" && i + 1 < argc)
+      options.filter = juce::String(argv[++i]) == "iir"
+                           ? DSP::OversamplingFilter::iir
+                           : DSP::OversamplingFilter::linearPhase;
+    else if (arg.startsWith("--"))
+      return false;
+    else
+      options.inputs.push_back(cwd.getChildFile(arg));
+  }
+
+  if (options.jobs <= 0)
+    options.jobs = juce::SystemStats::getNumCpus();
+
+  return options.mode >= 0 && options.mode < Engine::numModes &&
+         !options.inputs.empty();
+}
+
+// Calls job(worker, index) for every index in [0, numJobs) on `numWorkers`
+// threads. Indices are dealt out round robin; a worker takes its own from
+// the front of its queue and steals from the back of the others'. Jobs are
+// whole files, so a lock per queue costs nothing next to the work.
+template <typename Job>
+void runWorkStealing(int numJobs, int numWorkers, const Job &job) {
+  struct WorkQueue {
+    std::mutex lock;
+    std::deque<int> jobs;
+  };
+
+  numWorkers = juce::jlimit(1, juce::jmax(1, numJobs), numWorkers);
+  std::vector<WorkQueue> queues((size_t)numWorkers);
+
+  for (int i = 0; i < numJobs; ++i)
+    queues[(size_t)(i % numWorkers)].jobs.push_back(i);
+
+  auto takeOwn = [&](int worker, int &index) {
+    auto &queue = queues[(size_t)worker];
+    const std::scoped_lock lock(queue.lock);
+    if (queue.jobs.empty())
+      return false;
+    index = queue.jobs.front();
+    queue.jobs.pop_front();
+    return true;
+  };
+
+  // No jobs are added once the workers start, so when every queue is
+  // empty there is nothing left to wait for
+  auto steal = [&](int worker, int &index) {
+    for (int k = 1; k < numWorkers; ++k) {
+      auto &queue = queues[(size_t)((worker + k) % numWorkers)];
+      const std::scoped_lock lock(queue.lock);
+      if (!queue.jobs.empty()) {
+        index = queue.jobs.back();
+        queue.jobs.pop_back();
+        return true;
+      }
+    }
+    return false;
+  };
+
+  std::vector<std::thread> threads;
+
+  for (int worker = 0; worker < numWorkers; ++worker)
+    threads.emplace_back([&, worker] {
+      juce::ScopedNoDenormals noDenormals;
+      int index = 0;
+      while (takeOwn(worker, index) || steal(worker, index))
+        job(worker, index);
+    });
+
+  for (auto &thread : threads)
+    thread.join();
+}
+
+juce::File getOutputFile(const juce::File &input, const Options &options) {
+  const auto dir = options.outputDir == juce::File()
+                       ? input.getParentDirectory()
+                       : options.outputDir;
+  return dir.getChildFile(input.getFileNameWithoutExtension() + "_vcore" +
+                          input.getFileExtension());
+}
+
+// Every pair of inputs that would render to the same file, and every input
+// another one's output would overwrite, as one message each. Workers would
+// otherwise race to write the same file or read one while it is written.
+juce::StringArray findOutputCollisions(const Options &options) {
+  std::map<juce::File, juce::File> inputForOutput;
+  juce::StringArray collisions;
+
+  for (const auto &input : options.inputs) {
+    const auto output = getOutputFile(input, options);
+    const auto [it, added] = inputForOutput.emplace(output, input);
+    if (!added)
+      collisions.add(it->second.getFullPathName() + " and " +
+                     input.getFullPathName() + " would both render to " +
+                     output.getFullPathName());
+  }
+
+  for (const auto &[output, input] : inputForOutput)
+    if (std::find(options.inputs.begin(), options.inputs.end(), output) !=
+        options.inputs.end())
+      collisions.add(input.getFullPathName() + " would render over input " +
+                     output.getFullPathName());
+
+  return collisions;
+}
+
+// From the file's header. Zero if it can't be read; it then fails as soon as
+// a worker gets to it.
+double getLengthSeconds(const juce::File &input,
+                        juce::AudioFormatManager &formats) {
+  std::unique_ptr<juce::AudioFormatReader> reader(
+      formats.createReaderFor(input));
+  if (reader == nullptr || reader->sampleRate <= 0.0)
+    return 0.0;
+
+  return (double)reader->lengthInSamples / reader->sampleRate;
+}
+
+RenderResult renderFile(const juce::File &input, const Options &options,
+                        Engine &engine, juce::AudioFormatManager &formats) {
+  RenderResult result;
+  result.output = getOutputFile(input, options);
+  const auto start = Clock::now();
+
+  std::unique_ptr<juce::AudioFormatReader> reader(
+      formats.createReaderFor(input));
+  if (reader == nullptr) {
+    result.error = "can't read " + input.getFullPathName();
+    return result;
+  }
+
+  if (result.output == input) {
+    result.error = "output would overwrite " + input.getFullPathName();
+    return result;
+  }
+
+  auto *format = formats.findFormatForFileExtension(input.getFileExtension());
+  if (format == nullptr || !format->canHandleFile(result.output)) {
+    result.error = "can't write " + result.output.getFileName();
+    return result;
+  }
+
+  // Same bit depth as the input where the format can write it
+  const auto depths = format->getPossibleBitDepths();
+  auto bitsPerSample = (int)reader->bitsPerSample;
+  if (!depths.contains(bitsPerSample) && !depths.isEmpty())
+    bitsPerSample = depths.getLast();
+
+  const auto numChannels = (int)reader->numChannels;
+  const auto layout = reader->getChannelLayout();
+
+  result.output.getParentDirectory().createDirectory();
+  result.output.deleteFile();
+  auto stream = result.output.createOutputStream();
+  if (stream == nullptr) {
+    result.error = "can't create " + result.output.getFullPathName();
+    return result;
+  }
+
+  std::unique_ptr<juce::AudioFormatWriter> writer(
+      format->isChannelLayoutSupported(layout)
+          ? format->createWriterFor(stream.get(), reader->sampleRate, layout,
+                                    bitsPerSample, reader->metadataValues, 0)
+          : format->createWriterFor(stream.get(), reader->sampleRate,
+                                    (unsigned int)numChannels, bitsPerSample,
+                                    reader->metadataValues, 0));
+
+  // The output exists from here on. A file that stops partway through would
+  // still look like a good render, so on an error it goes.
+  auto fail = [&](const juce::String &error) {
+    writer.reset();
+    stream.reset();
+    result.output.deleteFile();
+    result.error = error;
+    return result;
+  };
+
+  if (writer == nullptr)
+    return fail("can't write " + result.output.getFileName() + " as " +
+                format->getFormatName());
+  stream.release(); // The writer owns it now
+
+  engine.setOversampling(options.oversamplingFactorLog2, options.filter);
+  engine.setWidenerPairs(DSP::getWidenerPairs(layout));
+  engine.prepare({reader->sampleRate, (juce::uint32)renderBlockSize,
+                  (juce::uint32)numChannels});
+  engine.setParameters(options.mode);
+
+  // The first `latency` samples out are the engine filling up. Drop them,
+  // and keep feeding silence past the end of the input until the last
+  // input sample has come out.
+  const auto totalSamples = reader->lengthInSamples;
+  auto samplesToTrim = (juce::int64)engine.getLatencySamples();
+  juce::int64 readPos = 0;
+  juce::int64 written = 0;
+
+  juce::AudioBuffer<float> buffer(numChannels, renderBlockSize);
+
+  while (written < totalSamples) {
+    buffer.clear();
+
+    const auto toRead =
+        (int)juce::jmin((juce::int64)renderBlockSize, totalSamples - readPos);
+    if (toRead > 0 && !reader->read(&buffer, 0, toRead, readPos, true, true))
+      return fail("read error in " + input.getFullPathName());
+    readPos += juce::jmax(0, toRead);
+
+    {
+      VCORE_REALTIME_STAGE("vcore_render process");
+      engine.process(buffer);
+    }
+
+    const auto trim =
+        (int)juce::jmin((juce::int64)renderBlockSize, samplesToTrim);
+    samplesToTrim -= trim;
+    const auto toWrite = (int)juce::jmin(
+        (juce::int64)(renderBlockSize - trim), totalSamples - written);
+
+    if (toWrite > 0 &&
+        !writer->writeFromAudioSampleBuffer(buffer, trim, toWrite))
+      return fail("write error in " + result.output.getFullPathName());
+    written += toWrite;
+  }
+
+  writer.reset();
+
+  result.ok = true;
+  result.audioSeconds = (double)totalSamples / reader->sampleRate;
+  result.busySeconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  return result;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage();
+    return 2;
+  }
+
+  if (const auto collisions = findOutputCollisions(options);
+      !collisions.isEmpty()) {
+    for (const auto &collision : collisions)
+      std::cerr << "error: " << collision << std::endl;
+    std::cerr << "nothing rendered: rename those inputs or render them to "
+                 "separate --output directories"
+              << std::endl;
+    return 2;
+  }
+
+  // Longest first, so a long file isn't the last one left while the other
+  // workers have nothing to do. By duration, not size: a 24-bit 5.1 WAV and
+  // a FLAC of the same length differ several times over in bytes.
+  {
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+
+    std::vector<std::pair<double, juce::File>> byLength;
+    for (const auto &input : options.inputs)
+      byLength.emplace_back(getLengthSeconds(input, formats), input);
+
+    std::stable_sort(byLength.begin(), byLength.end(),
+                     [](const auto &a, const auto &b) {
+                       return a.first > b.first;
+                     });
+
+    for (size_t i = 0; i < byLength.size(); ++i)
+      options.inputs[i] = byLength[i].second;
+  }
+
+  const auto numFiles = (int)options.inputs.size();
+  const auto numWorkers = juce::jmin(options.jobs, numFiles);
+
+  // One engine and one set of codecs per worker
+  std::vector<std::unique_ptr<Engine>> engines;
+  std::vector<std::unique_ptr<juce::AudioFormatManager>> formats;
+  for (int worker = 0; worker < numWorkers; ++worker) {
+    engines.push_back(std::make_unique<Engine>());
+    formats.push_back(std::make_unique<juce::AudioFormatManager>());
+    formats.back()->registerBasicFormats();
+  }
+
+  std::vector<RenderResult> results((size_t)numFiles);
+  std::mutex printLock;
+  const auto start = Clock::now();
+
+  runWorkStealing(numFiles, numWorkers, [&](int worker, int index) {
+    const auto &input = options.inputs[(size_t)index];
+    auto &result = results[(size_t)index];
+    result = renderFile(input, options, *engines[(size_t)worker],
+                        *formats[(size_t)worker]);
+
+    const std::scoped_lock lock(printLock);
+    if (result.ok)
+      std::cout << input.getFileName() << " -> "
+                << result.output.getFileName() << ": "
+                << juce::String(result.audioSeconds, 1) << " s, "
+                << juce::String(result.audioSeconds / result.busySeconds, 1)
+                << "x realtime" << std::endl;
+    else
+      std::cerr << "error: " << result.error << std::endl;
+  });
+
+  const auto wallSeconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  double audioSeconds = 0.0, busySeconds = 0.0;
+  int failed = 0;
+
+  for (const auto &result : results) {
+    audioSeconds += result.audioSeconds;
+    busySeconds += result.busySeconds;
+    failed += result.ok ? 0 : 1;
+  }
+
+  std::cout << (numFiles - failed) << " of " << numFiles << " files, "
+            << juce::String(audioSeconds, 1) << " s of audio in "
+            << juce::String(wallSeconds, 2) << " s on " << numWorkers
+            << " workers: "
+            << juce::String(audioSeconds / juce::jmax(wallSeconds, 1.0e-9), 1)
+            << "x realtime, "
+            << juce::String(audioSeconds / juce::jmax(busySeconds, 1.0e-9), 1)
+            << "x realtime per core" << std::endl;
+
+  return failed == 0 ? 0 : 1;
+}